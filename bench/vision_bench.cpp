@@ -0,0 +1,338 @@
+// Microbenchmarks de los kernels del pipeline sobre slices reales a 256, 384 y
+// 512 px, más un benchmark de extremo a extremo sobre la serie L096.
+//
+//   ./vision_bench --benchmark_filter=NLMeans
+//   ./vision_bench --benchmark_out=bench.json --benchmark_out_format=json
+//
+// Cada kernel informa MP/s (megapíxeles por segundo, tiempo real) y las
+// reservas de cv::Mat por llamada (allocs/call, bytes/call) del hilo que mide.
+#include "itk_loader.hpp"
+#include "itk_opencv_bridge.hpp"
+#include "slice_provider.hpp"
+#include "slice_source.hpp"
+#include "windowing.hpp"
+#include "highlight.hpp"
+#include "dnn_denoising.hpp"
+#include "processing.hpp"
+#include "morphology.hpp"
+#include "nlmeans.hpp"
+#include "pipeline.hpp"
+#include "profiler.hpp"
+#include "buffer_pool.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+const string kDataDir = VISION_DATA_DIR;
+const string kSeriesDir = kDataDir +
+    "/CT_low_dose_reconstruction_dataset/Original Data/Full Dose/3mm Slice Thickness/"
+    "Sharp Kernel (D45)/L096/full_3mm_sharp";
+
+string pngDir(int res) {
+    const string r = to_string(res);
+    return kDataDir + "/Preprocessed_" + r + "x" + r + "/" + r +
+           "/Full Dose/3mm/Sharp Kernel (D45)/L096";
+}
+
+// Entradas de una resolución: el PNG preprocesado (8 bits) y el slice HU
+// central de la serie IMA reescalado a esa resolución.
+struct BenchInputs {
+    Mat png8u;
+    Mat hu32f;
+    ImageType2D::Pointer itkSlice;  // HU en int16, como lo entrega GDCM
+};
+
+LazySliceProvider& seriesProvider() {
+    static LazySliceProvider provider(kSeriesDir);
+    return provider;
+}
+
+ImageType2D::Pointer toItkSlice(const Mat& hu16s) {
+    ImageType2D::SizeType size;
+    size[0] = hu16s.cols;
+    size[1] = hu16s.rows;
+    ImageType2D::RegionType region;
+    region.SetSize(size);
+
+    auto img = ImageType2D::New();
+    img->SetRegions(region);
+    img->Allocate();
+    for (int y = 0; y < hu16s.rows; ++y)
+        memcpy(img->GetBufferPointer() + (size_t)y * hu16s.cols, hu16s.ptr<short>(y),
+               hu16s.cols * sizeof(short));
+    return img;
+}
+
+const BenchInputs& inputs(int res) {
+    static map<int, BenchInputs> cache;
+    auto it = cache.find(res);
+    if (it != cache.end()) return it->second;
+
+    BenchInputs in;
+
+    vector<fs::path> pngs;
+    for (const auto& e : fs::directory_iterator(pngDir(res)))
+        if (e.path().extension() == ".png") pngs.push_back(e.path());
+    if (pngs.empty()) throw runtime_error("No hay PNG en " + pngDir(res));
+    sort(pngs.begin(), pngs.end());
+    in.png8u = imread(pngs[pngs.size() / 2].string(), IMREAD_GRAYSCALE);
+
+    LazySliceProvider& provider = seriesProvider();
+    Mat hu512 = itk2cv32fHU(provider.readSlice(provider.numSlices() / 2));
+    if (hu512.cols == res) in.hu32f = hu512;
+    else resize(hu512, in.hu32f, Size(res, res), 0, 0, INTER_AREA);
+
+    Mat hu16s;
+    in.hu32f.convertTo(hu16s, CV_16S);
+    in.itkSlice = toItkSlice(hu16s);
+
+    return cache.emplace(res, std::move(in)).first->second;
+}
+
+// Bucle de medida común: MP/s y reservas de cv::Mat por llamada.
+template <class F>
+void runKernel(benchmark::State& state, const Size& size, F&& body) {
+    const uint64_t allocs0 = Profiler::threadAllocations();
+    const uint64_t bytes0 = Profiler::threadAllocatedBytes();
+
+    for (auto _ : state) body();
+
+    const double n = (double)state.iterations();
+    state.counters["MP/s"] = benchmark::Counter(size.area() * n / 1e6, benchmark::Counter::kIsRate);
+    state.counters["allocs/call"] = (Profiler::threadAllocations() - allocs0) / n;
+    state.counters["bytes/call"] = (Profiler::threadAllocatedBytes() - bytes0) / n;
+}
+
+// Captura los errores de carga (p.ej. sin datos) y marca el benchmark
+#define BENCH_INPUTS(state, var)                              \
+    const BenchInputs* var##Ptr = nullptr;                    \
+    try { var##Ptr = &inputs((int)(state).range(0)); }        \
+    catch (const std::exception& e) { (state).SkipWithError(e.what()); return; } \
+    const BenchInputs& var = *var##Ptr
+
+// =========================================================
+// PUENTE ITK / VENTANEO
+// =========================================================
+void BM_itk2cv32fHU(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    runKernel(state, in.hu32f.size(), [&] {
+        Mat hu = itk2cv32fHU(in.itkSlice);
+        benchmark::DoNotOptimize(hu.data);
+    });
+}
+
+void BM_huTo8u(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    runKernel(state, in.hu32f.size(), [&] {
+        Mat img = huTo8u(in.hu32f, 40.0f, 400.0f);
+        benchmark::DoNotOptimize(img.data);
+    });
+}
+
+void BM_applyWindow(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    Mat dst;
+    runKernel(state, in.hu32f.size(), [&] {
+        applyWindow(in.hu32f, dst, kWindowSoftTissue);
+        benchmark::DoNotOptimize(dst.data);
+    });
+}
+
+// Blando, hueso y pulmón en una sola lectura del slice int16 (LUT de 64K)
+void BM_applyWindows16s(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    const Mat stored = itkSliceView16s(in.itkSlice);
+    const vector<HUWindow> ventanas = { kWindowSoftTissue, kWindowBone, kWindowLung };
+    vector<Mat> dsts;
+    runKernel(state, stored.size(), [&] {
+        applyWindows(stored, ventanas, dsts);
+        benchmark::DoNotOptimize(dsts.front().data);
+    });
+}
+
+// =========================================================
+// SEGMENTACIÓN
+// =========================================================
+void BM_generateAnatomicalMasksHU(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    runKernel(state, in.hu32f.size(), [&] {
+        AnatomyMasks m = generateAnatomicalMasksHU(in.hu32f);
+        benchmark::DoNotOptimize(m.labels.data);
+    });
+}
+
+void BM_colorizeAndOverlay(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    const Mat base = huTo8u(in.hu32f, 40.0f, 400.0f);
+    const AnatomyMasks masks = generateAnatomicalMasksHU(in.hu32f);
+    runKernel(state, base.size(), [&] {
+        Mat overlay = colorizeAndOverlay(base, masks);
+        benchmark::DoNotOptimize(overlay.data);
+    });
+}
+
+// =========================================================
+// SUAVIZADO
+// =========================================================
+void BM_NLMeans(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    Mat dst;
+    runKernel(state, in.png8u.size(), [&] {
+        fastNlMeansCT(in.png8u, dst);
+        benchmark::DoNotOptimize(dst.data);
+    });
+}
+
+void BM_DnnDenoise(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    static unique_ptr<DnnDenoiser> denoiser;
+    try {
+        if (!denoiser) denoiser = make_unique<DnnDenoiser>(VISION_MODEL_PATH);
+        denoiser->warmUp(in.png8u.size());
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+    runKernel(state, in.png8u.size(), [&] {
+        Mat clean = denoiser->denoise(in.png8u);
+        benchmark::DoNotOptimize(clean.data);
+    });
+}
+
+// Misma red cuantizada a INT8, calibrada con slices de la serie L096
+void BM_DnnDenoiseInt8(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    static unique_ptr<DnnDenoiser> denoiser;
+    try {
+        if (!denoiser) {
+            denoiser = make_unique<DnnDenoiser>(VISION_MODEL_PATH);
+            const vector<Mat> calib = sampleSlicesHU(*openSliceSource(kSeriesDir), 8);
+            if (!denoiser->quantizeInt8(calib, {}).accepted) throw runtime_error("Cuantizacion INT8 fallida");
+        }
+        denoiser->warmUp(in.png8u.size());
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+    runKernel(state, in.png8u.size(), [&] {
+        Mat clean = denoiser->denoise(in.png8u);
+        benchmark::DoNotOptimize(clean.data);
+    });
+}
+
+// =========================================================
+// PROCESSING.CPP Y MORFOLOGÍA
+// =========================================================
+void BM_equalize(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    runKernel(state, in.png8u.size(), [&] { benchmark::DoNotOptimize(equalize(in.png8u).data); });
+}
+
+void BM_denoiseClassic(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    runKernel(state, in.png8u.size(), [&] { benchmark::DoNotOptimize(denoiseClassic(in.png8u).data); });
+}
+
+void BM_edgesCanny(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    runKernel(state, in.png8u.size(), [&] { benchmark::DoNotOptimize(edgesCanny(in.png8u).data); });
+}
+
+void BM_morphOpen(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    runKernel(state, in.png8u.size(), [&] { benchmark::DoNotOptimize(morphOpen(in.png8u, 5).data); });
+}
+
+void BM_morphClose(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    runKernel(state, in.png8u.size(), [&] { benchmark::DoNotOptimize(morphClose(in.png8u, 5).data); });
+}
+
+void BM_morphAll(benchmark::State& state) {
+    BENCH_INPUTS(state, in);
+    const Mat k = getStructuringElement(MORPH_RECT, Size(3, 3));
+    MorphSet out;
+    runKernel(state, in.png8u.size(), [&] {
+        morphAll(in.png8u, k, out);
+        benchmark::DoNotOptimize(out.tophat.data);
+    });
+}
+
+// =========================================================
+// EXTREMO A EXTREMO: SERIE L096 COMPLETA
+// =========================================================
+// Lectura perezosa + HU + pipeline de 12 salidas por slice (sin guardar PNG).
+void BM_SeriesL096(benchmark::State& state) {
+    LazySliceProvider* provider = nullptr;
+    try { provider = &seriesProvider(); }
+    catch (const std::exception& e) { state.SkipWithError(e.what()); return; }
+
+    DnnDenoiser* denoiser = sharedDnnDenoiser(VISION_MODEL_PATH);
+    const unsigned n = (unsigned)provider->numSlices();
+    SliceOutputs out;
+    uint64_t pixels = 0;
+    const BufferPool::Stats pool0 = BufferPool::globalStats();
+
+    for (auto _ : state) {
+        for (unsigned z = 0; z < n; ++z) {
+            Mat hu = itk2cv32fHU(provider->readSlice(z));
+            processSliceHU(hu, denoiser, out);
+            pixels += hu.total();
+        }
+    }
+    state.counters["slices/s"] = benchmark::Counter((double)n * state.iterations(),
+                                                    benchmark::Counter::kIsRate);
+    state.counters["MP/s"] = benchmark::Counter(pixels / 1e6, benchmark::Counter::kIsRate);
+    // Reservas nuevas del pool de buffers (en régimen estacionario no crecen con la serie)
+    const BufferPool::Stats pool1 = BufferPool::globalStats();
+    state.counters["pool_misses"] = (double)(pool1.misses - pool0.misses);
+    state.counters["pool_hit%"] = pool1.acquires > pool0.acquires
+        ? 100.0 * (pool1.hits - pool0.hits) / (pool1.acquires - pool0.acquires) : 0.0;
+}
+
+} // namespace
+
+#define RESOLUTIONS ->Arg(256)->Arg(384)->Arg(512)->UseRealTime()->Unit(benchmark::kMillisecond)
+
+BENCHMARK(BM_itk2cv32fHU) RESOLUTIONS;
+BENCHMARK(BM_huTo8u) RESOLUTIONS;
+BENCHMARK(BM_applyWindow) RESOLUTIONS;
+BENCHMARK(BM_applyWindows16s) RESOLUTIONS;
+BENCHMARK(BM_generateAnatomicalMasksHU) RESOLUTIONS;
+BENCHMARK(BM_colorizeAndOverlay) RESOLUTIONS;
+BENCHMARK(BM_NLMeans) RESOLUTIONS;
+BENCHMARK(BM_DnnDenoise) RESOLUTIONS;
+BENCHMARK(BM_DnnDenoiseInt8) RESOLUTIONS;
+BENCHMARK(BM_equalize) RESOLUTIONS;
+BENCHMARK(BM_denoiseClassic) RESOLUTIONS;
+BENCHMARK(BM_edgesCanny) RESOLUTIONS;
+BENCHMARK(BM_morphOpen) RESOLUTIONS;
+BENCHMARK(BM_morphClose) RESOLUTIONS;
+BENCHMARK(BM_morphAll) RESOLUTIONS;
+BENCHMARK(BM_SeriesL096)->Iterations(1)->UseRealTime()->Unit(benchmark::kSecond);
+
+int main(int argc, char** argv) {
+    // Solo el asignador contador: sin registro de etapas que distorsione los tiempos
+    Profiler::setAllocationCounting(true);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,304 @@
+#include "batch.hpp"
+#include "slice_source.hpp"
+#include "series_cache.hpp"
+#include "dnn_denoising.hpp"
+#include "pipeline.hpp"
+#include "bounded_queue.hpp"
+#include "thread_pool.hpp"
+#include "profiler.hpp"
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+namespace fs = std::filesystem;
+
+static string sliceDirName(unsigned z) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "slice_%04u", z);
+    return buf;
+}
+
+namespace {
+
+// Bloque de slices consecutivos ya leídos: la unidad que viaja de la etapa de
+// decodificación a la de procesado. Con un .huv cada slice lleva su vista
+// int16 sin copia (ventanas por LUT) y el HU float solo si DnCNN lo necesita.
+struct DecodedChunk {
+    unsigned z0 = 0;
+    vector<SliceInput> slices;
+};
+
+unsigned defaultThreads() { return max(1u, thread::hardware_concurrency()); }
+
+} // namespace
+
+int runBatch(const BatchOptions& opt) {
+    using Clock = chrono::steady_clock;
+    const auto t0 = Clock::now();
+
+    // Solo cabeceras (o el .huv por mmap): los píxeles se leen slice a slice en
+    // la etapa de decodificación, así la memoria no depende de la longitud de la serie.
+    cout << "[BATCH] Analizando serie: " << opt.dicomDir << "\n";
+    // Origen compartido por la caché de series pero sin guardar slices: la
+    // serie se recorre una sola vez
+    shared_ptr<SliceSource> source;
+    {
+        PROFILE_SCOPE("series_open");
+        source = globalSeriesCache().openSource(opt.dicomDir);
+    }
+    const unsigned numSlices = (unsigned)source->numSlices();
+    const auto tScanned = Clock::now();
+    if (numSlices == 0) {
+        cerr << "[ERROR] La serie no tiene slices.\n";
+        return 1;
+    }
+
+    const unsigned processThreads = opt.threads ? opt.threads : defaultThreads();
+    const unsigned decodeThreads = max(1u, opt.decodeThreads);
+    // Por defecto los núcleos que no ocupan los hilos de proceso: con todos
+    // ocupados por slices (lo normal) queda en 1 y las franjas de NLMeans o el
+    // forward no añadirían nada; con --threads menor que los núcleos, sí
+    const int dnnThreads = opt.dnnThreads > 0 ? opt.dnnThreads
+                                              : (int)max(1u, defaultThreads() / processThreads);
+    const unsigned dnnBatch = max(1u, opt.dnnBatch);
+    const unsigned numChunks = (numSlices + dnnBatch - 1) / dnnBatch;
+    // Con la cola llena los decodificadores esperan: en vuelo como mucho
+    // (cola + uno por hilo de proceso + uno por decodificador) bloques
+    BoundedQueue<DecodedChunk> decoded(opt.queueDepth ? opt.queueDepth : 2 * processThreads);
+
+    // La codificación de las salidas se solapa con el procesado de los slices siguientes
+    OutputWriter writer(opt.writer);
+    cout << "[BATCH] Origen: " << source->kind() << " | " << numSlices << " slices | hilos: " << decodeThreads << " lectura, "
+         << processThreads << " proceso (" << dnnThreads << " de OpenCV por forward), "
+         << writer.options().threads << " escritura ("
+         << outputFormatExtension(writer.options().format) << ") | cola de "
+         << decoded.capacity() << " bloques de " << dnnBatch << " slices\n";
+
+    // NLMeans rápido a prueba: se compara con la referencia de OpenCV en el slice central
+    const NLMeansEngine nlmMotor = (opt.outputs & (1u << 2)) ? chooseNLMeansEngine(*source, opt.nlmEngine)
+                                                             : NLMeansEngine::OpenCV;
+    const bool conVecinos = nlmMotor == NLMeansEngine::Fast3D;
+
+    // El paralelismo va por slices: por defecto OpenCV solo usa dentro de cada
+    // forward o NLMeans los núcleos sobrantes (sin sobre-suscripción).
+    // Se fija una vez para todo el modo y se restaura al salir de runBatch.
+    DnnThreadsScope hilosDnn(dnnThreads);
+
+    // Un DnnDenoiser por hilo de proceso (cv::dnn::Net no es reentrante); se
+    // carga y se calienta una sola vez por hilo, no por slice.
+    const bool needDnn = outputsNeedDnn(opt.outputs);
+    vector<unique_ptr<DnnDenoiser>> denoisers(processThreads);
+    if (needDnn) {
+        // INT8: slices de calibración leídas una sola vez para todos los hilos
+        vector<Mat> calibracion, validacion;
+        if (opt.dnnPrecision == DnnPrecision::INT8) {
+            try {
+                // Por la caché: las slices de calibración no se decodifican otra vez
+                splitCalibration(sampleSlicesHU(*globalSeriesCache().open(opt.calibrationDir), opt.calibrationSlices),
+                                 calibracion, validacion);
+            } catch (const std::exception& e) {
+                cout << "[AVISO] Sin slices de calibracion (" << e.what() << "): DnCNN en FP32\n";
+            }
+        }
+        bool validado = false, int8Aceptada = false;
+
+        const Size sliceSize = source->sliceSize();
+        string errorDnn;
+        for (size_t w = 0; w < denoisers.size() && errorDnn.empty(); ++w) {
+            auto& d = denoisers[w];
+            try {
+                d = make_unique<DnnDenoiser>(opt.modelPath);
+                if (opt.dnnTile > 0) {
+                    TileOptions tiles;
+                    tiles.tileSize = opt.dnnTile;
+                    tiles.threads = 1;  // el paralelismo ya va por slices
+                    d->setTiling(tiles);
+                }
+                if (!calibracion.empty()) {
+                    // Las guardas se comprueban con el primer denoiser; el resto
+                    // (misma red, mismas slices) solo se cuantiza si se aceptó
+                    if (!validado) {
+                        const QuantizationReport r = d->quantizeInt8(calibracion, validacion);
+                        printQuantizationReport(r);
+                        validado = true;
+                        int8Aceptada = r.accepted;
+                    } else if (int8Aceptada) {
+                        d->quantizeInt8(calibracion, {});
+                    }
+                }
+                d->warmUp(sliceSize, (int)dnnBatch);
+            }
+            catch (const std::exception& e) {
+                errorDnn = "hilo " + to_string(w) + ": " + e.what();
+            }
+        }
+        // Todos los hilos o ninguno: con un denoiser caído, sus slices saldrían
+        // sin DnCNN mezclados con los del resto
+        if (!errorDnn.empty()) {
+            for (auto& d : denoisers) d.reset();
+            cout << "[AVISO] DNN no disponible (" << errorDnn << "): toda la serie sin DnCNN\n";
+        }
+    }
+
+    PipelineOptions pipelineOpt;
+    pipelineOpt.outputs = opt.outputs;
+    pipelineOpt.extraWindows = opt.extraWindows;
+    pipelineOpt.nlmEngine = nlmMotor;
+    atomic<unsigned> done{0}, failed{0};
+    atomic<unsigned> nextChunk{0}, activeDecoders{decodeThreads};
+    atomic<int64_t> decodeUs{0}, processUs{0};
+    // Estado del pool a mitad de serie: las reservas posteriores miden el régimen estacionario
+    // (solo lo escribe el hilo que completa ese slice; se lee tras waitIdle)
+    BufferPool::Stats poolHalfway;
+    auto elapsedUs = [](Clock::time_point a) {
+        return chrono::duration_cast<chrono::microseconds>(Clock::now() - a).count();
+    };
+
+    // ---- Etapa 1: lectura (DICOM o mmap) + conversión a HU ----
+    auto decodeLoop = [&] {
+        for (unsigned c; (c = nextChunk++) < numChunks;) {
+            const auto tc = Clock::now();
+            DecodedChunk chunk;
+            chunk.z0 = c * dnnBatch;
+            const unsigned z1 = min(numSlices, chunk.z0 + dnnBatch);
+            try {
+                for (unsigned z = chunk.z0; z < z1; ++z) {
+                    PROFILE_SCOPE("slice_read");
+                    SliceInput in;
+                    in.stored16s = source->storedSlice16s(z, in.rescale);
+                    if (in.stored16s.empty() || needDnn) in.hu32f = source->readSliceHU(z);
+                    chunk.slices.push_back(in);
+                }
+                if (conVecinos) {
+                    // Fast3D: z-1 y z+1 en la representación del slice; dentro
+                    // del bloque se comparten, solo los bordes se leen de nuevo
+                    auto representacion = [](const SliceInput& s) { return s.stored16s.empty() ? s.hu32f : s.stored16s; };
+                    auto leerVecino = [&](unsigned z) {
+                        PROFILE_SCOPE("slice_read");
+                        RescaleParams r;
+                        Mat m = source->storedSlice16s(z, r);
+                        return m.empty() ? source->readSliceHU(z) : m;
+                    };
+                    const unsigned n = z1 - chunk.z0;
+                    for (unsigned i = 0; i < n; ++i) {
+                        const unsigned z = chunk.z0 + i;
+                        SliceInput& in = chunk.slices[i];
+                        if (i > 0) in.prevSlice = representacion(chunk.slices[i - 1]);
+                        else if (z > 0) in.prevSlice = leerVecino(z - 1);
+                        if (i + 1 < n) in.nextSlice = representacion(chunk.slices[i + 1]);
+                        else if (z + 1 < numSlices) in.nextSlice = leerVecino(z + 1);
+                    }
+                }
+            } catch (const std::exception& e) {
+                failed += z1 - chunk.z0;
+                cerr << "[ERROR] Lectura slices " << chunk.z0 << "-" << (z1 - 1) << ": " << e.what() << "\n";
+                continue;
+            }
+            decodeUs += elapsedUs(tc);
+            decoded.push(std::move(chunk));
+        }
+        // El último decodificador en terminar cierra la cola
+        if (--activeDecoders == 0) decoded.close();
+    };
+
+    // ---- Etapa 2: DnCNN por bloque + pipeline por slice ----
+    auto processLoop = [&] {
+        // Un denoiser por worker del pool de proceso
+        DnnDenoiser* denoiser = denoisers[ThreadPool::currentWorkerIndex()].get();
+        SliceOutputs outputs;
+        DecodedChunk chunk;
+        while (decoded.pop(chunk)) {
+            const auto tc = Clock::now();
+            const unsigned n = (unsigned)chunk.slices.size();
+            vector<Mat> huDnn(n);
+            if (denoiser) {
+                try {
+                    PROFILE_SCOPE("dncnn_batch");
+                    vector<Mat> hu(n);
+                    for (unsigned i = 0; i < n; ++i) hu[i] = chunk.slices[i].hu32f;
+                    huDnn = denoiser->denoiseBatchHU(hu);
+                } catch (const std::exception& e) {
+                    failed += n;
+                    cerr << "[ERROR] DnCNN slices " << chunk.z0 << "-" << (chunk.z0 + n - 1) << ": " << e.what() << "\n";
+                    continue;
+                }
+            }
+
+            for (unsigned i = 0; i < n; ++i) {
+                const unsigned z = chunk.z0 + i;
+                try {
+                    processSliceHU(chunk.slices[i], huDnn[i], outputs, pipelineOpt);
+                    // ---- Etapa 3: escritura asíncrona (cola acotada del escritor) ----
+                    saveSliceOutputs(outputs, (fs::path(opt.outputDir) / sliceDirName(z)).string(), writer);
+                    // Los buffers ya son del escritor: vuelven al pool cuando los codifique
+                    // y el siguiente slice toma otros libres
+                    outputs = SliceOutputs();
+
+                    const unsigned k = ++done;
+                    if (k == numSlices / 2) poolHalfway = BufferPool::globalStats();
+                    if (k % 25 == 0 || k == numSlices)
+                        cout << "[BATCH] " << k << "/" << numSlices << " slices\n";
+                } catch (const std::exception& e) {
+                    ++failed;
+                    cerr << "[ERROR] Slice " << z << ": " << e.what() << "\n";
+                }
+            }
+            processUs += elapsedUs(tc);
+        }
+    };
+
+    // Cada etapa en su pool, un bucle por worker: la cola acotada entre ellas
+    // frena la lectura (las colas del pool no tienen límite) y los buffers del
+    // pool de cada hilo sobreviven entre bloques
+    {
+        ThreadPool decodePool(decodeThreads), processPool(processThreads);
+        for (unsigned i = 0; i < decodeThreads; ++i) decodePool.submit(decodeLoop);
+        for (unsigned w = 0; w < processThreads; ++w) processPool.submit(processLoop);
+        decodePool.waitIdle();
+        processPool.waitIdle();
+    }
+    const WriterStats ws = writer.flush();
+    const BufferPool::Stats ps = BufferPool::globalStats();
+    // Fin de la serie: los pools de las etapas se fueron con sus hilos; el de
+    // este hilo aún guarda los buffers de la comprobación de NLMeans y la calibración
+    threadBufferPool().trim();
+
+    const auto t1 = Clock::now();
+    const double scanSec  = chrono::duration<double>(tScanned - t0).count();
+    const double procSec  = chrono::duration<double>(t1 - tScanned).count();
+    const double totalSec = chrono::duration<double>(t1 - t0).count();
+
+    const unsigned ok = done.load();
+    cout << "\n[RESUMEN] Slices procesados: " << ok << "/" << numSlices
+         << " (fallidos: " << failed.load() << ")\n"
+         << "[RESUMEN] Apertura de la serie: " << scanSec << " s | Streaming: " << procSec
+         << " s | Total: " << totalSec << " s\n"
+         << "[RESUMEN] Tiempo de hilo: lectura " << decodeUs.load() / 1e6 << " s, proceso "
+         << processUs.load() / 1e6 << " s, escritura " << ws.encodeMs / 1000.0
+         << " s (pico de cola: " << decoded.peak() << "/" << decoded.capacity() << " bloques)\n"
+         << "[RESUMEN] Throughput: " << (procSec > 0 ? ok / procSec : 0.0) << " slices/s ("
+         << (totalSec > 0 ? ok / totalSec : 0.0) << " slices/s incluyendo apertura)\n"
+         << "[RESUMEN] Escritura: " << ws.written << " imagenes (fallidas: " << ws.failed << "), "
+         << ws.bytes / (1024.0 * 1024.0) << " MB, " << ws.blockedMs / 1000.0
+         << " s de espera por cola llena\n"
+         << "[RESUMEN] Pool de buffers: " << ps.acquires << " peticiones, "
+         << (ps.acquires ? 100.0 * ps.hits / ps.acquires : 0.0) << "% reutilizadas, " << ps.misses
+         << " reservas (" << ps.bytesAllocated / (1024.0 * 1024.0) << " MB)\n"
+         << "[RESUMEN] Reservas del pool en la segunda mitad de la serie: "
+         << ps.misses - poolHalfway.misses << " ("
+         << (ps.bytesAllocated - poolHalfway.bytesAllocated) / (1024.0 * 1024.0) << " MB)\n"
+         << "[RESUMEN] Salidas en: " << opt.outputDir << "\n";
+
+    return failed.load() == 0 && ws.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "pipeline.hpp"
+#include "output_writer.hpp"
+#include "dnn_denoising.hpp"  // DnnPrecision
+#include <string>
+#include <vector>
+
+// Modo batch sin GUI: procesa todos los slices de una serie DICOM y guarda las
+// evidencias seleccionadas de cada slice en <outputDir>/slice_XXXX/.
+// Funciona en streaming con tres etapas solapadas y colas acotadas entre ellas:
+// lectura DICOM + HU (pool de decodeThreads) -> DnCNN + pipeline (pool de
+// threads) -> escritura (writer.threads). La serie nunca se carga entera: en memoria solo hay unos
+// pocos bloques en vuelo, sea cual sea su longitud.
+struct BatchOptions {
+  std::string dicomDir;
+  std::string outputDir = "outputs/batch";
+  std::string modelPath = "../models/dncnn_compatible.onnx";
+  unsigned threads = 0;       // hilos de proceso; 0 => todos los núcleos
+  unsigned decodeThreads = 2; // hilos de lectura DICOM
+  int dnnThreads = 0;         // hilos de OpenCV (forward DnCNN, franjas NLMeans); 0 => núcleos / threads
+  unsigned queueDepth = 0;    // bloques decodificados en cola; 0 => 2 × threads
+  unsigned dnnBatch = 4; // slices por forward DnCNN ([N,1,H,W])
+  int dnnTile = 0;       // >0: DnCNN por teselas de ese tamaño (memoria acotada)
+  // INT8: se calibra con calibrationSlices slices de calibrationDir y solo se
+  // usa si supera las guardas de PSNR/SSIM frente a FP32
+  DnnPrecision dnnPrecision = DnnPrecision::FP32;
+  std::string calibrationDir = "../data/CT_low_dose_reconstruction_dataset/Original Data/Full Dose/"
+                               "3mm Slice Thickness/Sharp Kernel (D45)/L096/full_3mm_sharp";
+  unsigned calibrationSlices = 16;  // la mitad calibra, la otra mitad valida
+  // Motor de la salida 3. Los rápidos solo si en el slice central superan
+  // kNLMeansMinPSNR frente a cv::fastNlMeansDenoising (si no, la referencia)
+  NLMeansEngine nlmEngine = NLMeansEngine::OpenCV;
+  OutputMask outputs = kAllOutputs;  // solo se ejecutan las etapas que estas necesitan
+  std::vector<HUWindow> extraWindows;  // salida 1 también en estas ventanas (p.ej. hueso, pulmón)
+  WriterOptions writer;              // formato y pool de escritura asíncrona
+};
+
+// Devuelve el código de salida del proceso (0 si todos los slices terminaron bien).
+int runBatch(const BatchOptions& opt);
@@ -0,0 +1,60 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Cola FIFO acotada entre etapas de un pipeline productor/consumidor.
+// push() bloquea con la cola llena (backpressure) y pop() con la cola vacía.
+// close() despierta a todos: a partir de ahí push() falla y pop() vacía lo
+// que quede y después devuelve false.
+template <class T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+  bool push(T item) {
+    std::unique_lock<std::mutex> lk(m_);
+    notFull_.wait(lk, [this] { return closed_ || items_.size() < capacity_; });
+    if (closed_) return false;
+    items_.push_back(std::move(item));
+    if (items_.size() > peak_) peak_ = items_.size();
+    lk.unlock();
+    notEmpty_.notify_one();
+    return true;
+  }
+
+  bool pop(T& out) {
+    std::unique_lock<std::mutex> lk(m_);
+    notEmpty_.wait(lk, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty()) return false;
+    out = std::move(items_.front());
+    items_.pop_front();
+    lk.unlock();
+    notFull_.notify_one();
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      closed_ = true;
+    }
+    notFull_.notify_all();
+    notEmpty_.notify_all();
+  }
+
+  size_t capacity() const { return capacity_; }
+
+  size_t peak() const {
+    std::lock_guard<std::mutex> lk(m_);
+    return peak_;
+  }
+
+private:
+  const size_t capacity_;
+  mutable std::mutex m_;
+  std::condition_variable notFull_, notEmpty_;
+  std::deque<T> items_;
+  size_t peak_ = 0;
+  bool closed_ = false;
+};
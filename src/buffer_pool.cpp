@@ -0,0 +1,121 @@
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+using namespace cv;
+
+namespace {
+
+// Registro de pools vivos + acumulado de los destruidos, para globalStats()
+std::mutex& registryMutex() {
+  static std::mutex m;
+  return m;
+}
+std::vector<const BufferPool*>& registry() {
+  static std::vector<const BufferPool*> pools;
+  return pools;
+}
+BufferPool::Stats& retiredStats() {
+  static BufferPool::Stats s;
+  return s;
+}
+
+void accumulate(BufferPool::Stats& acc, const BufferPool::Stats& s) {
+  acc.acquires += s.acquires;
+  acc.hits += s.hits;
+  acc.misses += s.misses;
+  acc.bytesAllocated += s.bytesAllocated;
+  acc.buffers += s.buffers;
+  acc.bytesHeld += s.bytesHeld;
+}
+
+bool isFree(const Mat& m) {
+  // Lectura atómica: otros hilos pueden estar soltando su referencia
+  return m.u && CV_XADD(&m.u->refcount, 0) == 1;
+}
+
+} // namespace
+
+BufferPool::BufferPool() {
+  std::lock_guard<std::mutex> lk(registryMutex());
+  registry().push_back(this);
+}
+
+BufferPool::~BufferPool() {
+  std::lock_guard<std::mutex> lk(registryMutex());
+  auto& r = registry();
+  r.erase(std::remove(r.begin(), r.end(), this), r.end());
+  Stats s = stats();
+  s.buffers = s.bytesHeld = 0;  // ya no los retiene nadie del pool
+  accumulate(retiredStats(), s);
+}
+
+Mat BufferPool::acquire(Size size, int type) {
+  acquires_.fetch_add(1, std::memory_order_relaxed);
+  auto& bucket = buckets_[std::make_tuple(size.height, size.width, type)];
+  for (const Mat& m : bucket) {
+    if (isFree(m)) {
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return m;
+    }
+  }
+
+  Mat m(size, type);
+  const std::uint64_t bytes = m.total() * m.elemSize();
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  bytesAllocated_.fetch_add(bytes, std::memory_order_relaxed);
+  buffers_.fetch_add(1, std::memory_order_relaxed);
+  bytesHeld_.fetch_add(bytes, std::memory_order_relaxed);
+  bucket.push_back(m);
+  return m;
+}
+
+Mat BufferPool::acquireZeros(Size size, int type) {
+  Mat m = acquire(size, type);
+  m.setTo(Scalar::all(0));
+  return m;
+}
+
+void BufferPool::ensure(Mat& dst, Size size, int type) {
+  if (!dst.empty() && dst.size() == size && dst.type() == type && dst.isContinuous()) return;
+  dst = acquire(size, type);
+}
+
+void BufferPool::trim() {
+  for (auto& kv : buckets_) {
+    auto& bucket = kv.second;
+    for (auto it = bucket.begin(); it != bucket.end();) {
+      if (isFree(*it)) {
+        buffers_.fetch_sub(1, std::memory_order_relaxed);
+        bytesHeld_.fetch_sub(it->total() * it->elemSize(), std::memory_order_relaxed);
+        it = bucket.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+BufferPool::Stats BufferPool::stats() const {
+  Stats s;
+  s.acquires = acquires_.load(std::memory_order_relaxed);
+  s.hits = hits_.load(std::memory_order_relaxed);
+  s.misses = misses_.load(std::memory_order_relaxed);
+  s.bytesAllocated = bytesAllocated_.load(std::memory_order_relaxed);
+  s.buffers = buffers_.load(std::memory_order_relaxed);
+  s.bytesHeld = bytesHeld_.load(std::memory_order_relaxed);
+  return s;
+}
+
+BufferPool::Stats BufferPool::globalStats() {
+  std::lock_guard<std::mutex> lk(registryMutex());
+  Stats total = retiredStats();
+  for (const BufferPool* p : registry()) accumulate(total, p->stats());
+  return total;
+}
+
+BufferPool& threadBufferPool() {
+  thread_local BufferPool pool;
+  return pool;
+}
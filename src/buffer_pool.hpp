@@ -0,0 +1,58 @@
+#pragma once
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Pool de buffers cv::Mat por hilo, indexado por (filas, columnas, tipo).
+// Un buffer está libre cuando el pool es su único dueño (recuento de
+// referencias == 1): no hay que devolverlo a mano, basta con soltar todas
+// las Mat que lo comparten (también desde otros hilos, p.ej. el escritor).
+// Las reservas van por el asignador de OpenCV (alineadas a 64 bytes).
+// En régimen estacionario un slice no hace reservas grandes: todo sale del pool.
+class BufferPool {
+public:
+  struct Stats {
+    std::uint64_t acquires = 0;
+    std::uint64_t hits = 0;             // servidas con un buffer libre
+    std::uint64_t misses = 0;           // reservas nuevas
+    std::uint64_t bytesAllocated = 0;   // suma de las reservas nuevas
+    std::uint64_t buffers = 0;          // buffers retenidos ahora
+    std::uint64_t bytesHeld = 0;
+  };
+
+  BufferPool();
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  // Buffer de ese tamaño y tipo (contenido sin inicializar).
+  cv::Mat acquire(cv::Size size, int type);
+  cv::Mat acquireZeros(cv::Size size, int type);
+
+  // Deja dst listo para escribir. dst es un buffer del llamador, como la
+  // salida de cualquier función de OpenCV: si ya tiene tamaño y tipo se
+  // escribe encima (el llamador garantiza que nadie más lo está leyendo); si
+  // no, se sustituye por un buffer del pool. El recuento de referencias no
+  // dice quién es el dueño, así que no se consulta.
+  void ensure(cv::Mat& dst, cv::Size size, int type);
+
+  // Suelta los buffers libres.
+  void trim();
+
+  Stats stats() const;
+  // Suma de los pools de todos los hilos (incluidos los ya terminados).
+  static Stats globalStats();
+
+private:
+  std::map<std::tuple<int, int, int>, std::vector<cv::Mat>> buckets_;  // solo el hilo dueño
+  std::atomic<std::uint64_t> acquires_{0}, hits_{0}, misses_{0}, bytesAllocated_{0};
+  std::atomic<std::uint64_t> buffers_{0}, bytesHeld_{0};
+};
+
+// Pool del hilo actual.
+BufferPool& threadBufferPool();
@@ -0,0 +1,314 @@
+#include "dicom_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <unordered_set>
+#include <gdcmReader.h>
+#include <gdcmTag.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* kIndexHeader = "# dicom_index v2";
+constexpr int kNumFields = 18;
+
+const gdcm::Tag kSeriesUIDTag(0x0020, 0x000e);
+const gdcm::Tag kInstanceNumberTag(0x0020, 0x0013);
+const gdcm::Tag kPositionTag(0x0020, 0x0032);
+const gdcm::Tag kOrientationTag(0x0020, 0x0037);
+// Detalles de serie de gdcm::SerieHelper (UseSeriesDetails)
+const gdcm::Tag kSeriesNumberTag(0x0020, 0x0011);
+const gdcm::Tag kSequenceNameTag(0x0018, 0x0024);
+const gdcm::Tag kSliceThicknessTag(0x0018, 0x0050);
+const gdcm::Tag kRowsTag(0x0028, 0x0010);
+const gdcm::Tag kColumnsTag(0x0028, 0x0011);
+
+// Valor de texto de un elemento (UI, IS, DS), sin el relleno final
+std::string tagString(const gdcm::DataSet& ds, const gdcm::Tag& tag) {
+  if (!ds.FindDataElement(tag)) return "";
+  const gdcm::ByteValue* bv = ds.GetDataElement(tag).GetByteValue();
+  if (!bv) return "";
+  std::string s(bv->GetPointer(), bv->GetLength());
+  while (!s.empty() && (s.back() == '\0' || s.back() == ' ')) s.pop_back();
+  s.erase(0, s.find_first_not_of(' '));
+  return s;
+}
+
+// "a\b\c" (multivalor DICOM) -> números
+std::vector<double> parseNumbers(const std::string& s) {
+  std::vector<double> values;
+  std::stringstream ss(s);
+  for (std::string item; std::getline(ss, item, '\\');) values.push_back(std::strtod(item.c_str(), nullptr));
+  return values;
+}
+
+// Filas/columnas son US (binario, little-endian como casi todo DICOM), no texto.
+// Solo se usan para distinguir series: basta con que sean estables.
+std::string tagUS(const gdcm::DataSet& ds, const gdcm::Tag& tag) {
+  if (!ds.FindDataElement(tag)) return "";
+  const gdcm::ByteValue* bv = ds.GetDataElement(tag).GetByteValue();
+  if (!bv || bv->GetLength() < 2) return "";
+  std::uint16_t v = 0;
+  std::memcpy(&v, bv->GetPointer(), sizeof(v));
+  return std::to_string(v);
+}
+
+// Solo cabecera: ReadSelectedTags se detiene tras el último tag pedido
+// (grupo 0028), antes del pixel data.
+bool readHeader(const std::string& path, DicomFileRecord& r) {
+  gdcm::Reader reader;
+  reader.SetFileName(path.c_str());
+  if (!reader.ReadSelectedTags({kSequenceNameTag, kSliceThicknessTag, kSeriesUIDTag, kSeriesNumberTag,
+                                kInstanceNumberTag, kPositionTag, kOrientationTag, kRowsTag, kColumnsTag}))
+    return false;
+  const gdcm::DataSet& ds = reader.GetFile().GetDataSet();
+
+  r.seriesUID = tagString(ds, kSeriesUIDTag);
+  if (r.seriesUID.empty()) return false;
+  r.seriesDetails = tagString(ds, kSeriesNumberTag) + '.' + tagString(ds, kSequenceNameTag) + '.' +
+                    tagString(ds, kSliceThicknessTag) + '.' + tagUS(ds, kRowsTag) + '.' + tagUS(ds, kColumnsTag);
+  r.instanceNumber = std::atoi(tagString(ds, kInstanceNumberTag).c_str());
+
+  const std::vector<double> pos = parseNumbers(tagString(ds, kPositionTag));
+  const std::vector<double> ori = parseNumbers(tagString(ds, kOrientationTag));
+  r.hasGeometry = pos.size() == 3 && ori.size() == 6;
+  if (r.hasGeometry) {
+    std::copy(pos.begin(), pos.end(), r.position);
+    std::copy(ori.begin(), ori.end(), r.orientation);
+  }
+  return true;
+}
+
+std::int64_t mtimeOf(const fs::directory_entry& e) {
+  return e.last_write_time().time_since_epoch().count();
+}
+
+bool isUnder(const std::string& path, const std::string& root) {
+  return path.size() > root.size() && path.compare(0, root.size(), root) == 0 &&
+         path[root.size()] == fs::path::preferred_separator;
+}
+
+// Orden Z de GDCM (gdcm::SerieHelper): distancia sobre la normal del corte si
+// todos comparten orientación y las distancias son distintas; si no, número
+// de instancia si no se repite; si no, nombre de archivo.
+void sortLikeGdcm(std::vector<const DicomFileRecord*>& files) {
+  auto byName = [](const DicomFileRecord* a, const DicomFileRecord* b) { return a->path < b->path; };
+  std::sort(files.begin(), files.end(), byName);
+  if (files.size() < 2) return;
+
+  bool geometry = true;
+  const double* o = files.front()->orientation;
+  for (const DicomFileRecord* f : files) {
+    if (!f->hasGeometry) { geometry = false; break; }
+    for (int i = 0; i < 6; ++i)
+      if (std::abs(f->orientation[i] - o[i]) > 1e-6) geometry = false;
+  }
+  if (geometry) {
+    const double n[3] = { o[1] * o[5] - o[2] * o[4], o[2] * o[3] - o[0] * o[5], o[0] * o[4] - o[1] * o[3] };
+    auto dist = [&n](const DicomFileRecord* f) {
+      return n[0] * f->position[0] + n[1] * f->position[1] + n[2] * f->position[2];
+    };
+    std::vector<const DicomFileRecord*> sorted = files;
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [&](const DicomFileRecord* a, const DicomFileRecord* b) { return dist(a) < dist(b); });
+    bool distinct = true;
+    for (size_t i = 1; i < sorted.size() && distinct; ++i) distinct = dist(sorted[i - 1]) != dist(sorted[i]);
+    if (distinct) {
+      files = std::move(sorted);
+      return;
+    }
+  }
+
+  std::vector<const DicomFileRecord*> sorted = files;
+  std::stable_sort(sorted.begin(), sorted.end(), [](const DicomFileRecord* a, const DicomFileRecord* b) {
+    return a->instanceNumber < b->instanceNumber;
+  });
+  bool distinct = true;
+  for (size_t i = 1; i < sorted.size() && distinct; ++i)
+    distinct = sorted[i - 1]->instanceNumber != sorted[i]->instanceNumber;
+  if (distinct) files = std::move(sorted);
+}
+
+} // namespace
+
+DicomIndex::DicomIndex(std::string indexPath) : path_(std::move(indexPath)) {}
+
+void DicomIndex::load() {
+  records_.clear();
+  std::ifstream in(path_);
+  std::string line;
+  if (in && std::getline(in, line) && line == kIndexHeader) {
+    while (std::getline(in, line)) {
+      std::vector<std::string> f;
+      std::stringstream ss(line);
+      for (std::string item; std::getline(ss, item, '\t');) f.push_back(item);
+      if (f.size() != kNumFields) continue;  // línea dañada: se releerá en update()
+
+      DicomFileRecord r;
+      r.path = f[0];
+      r.size = std::strtoull(f[1].c_str(), nullptr, 10);
+      r.mtime = std::strtoll(f[2].c_str(), nullptr, 10);
+      r.seriesUID = f[3];
+      r.seriesDetails = f[4];
+      r.instanceNumber = std::atoi(f[5].c_str());
+      r.hasGeometry = f[6] == "1";
+      for (int i = 0; i < 3; ++i) r.position[i] = std::strtod(f[7 + i].c_str(), nullptr);
+      for (int i = 0; i < 6; ++i) r.orientation[i] = std::strtod(f[10 + i].c_str(), nullptr);
+      // f[16]: Z en su serie y f[17]: tamaño de la serie, informativos (se recalculan)
+      records_.emplace(r.path, std::move(r));
+    }
+  }
+  rebuildSeries();
+  dirty_ = false;
+}
+
+bool DicomIndex::save() {
+  try {
+    const fs::path target(path_);
+    if (target.has_parent_path()) fs::create_directories(target.parent_path());
+    const std::string tmp = path_ + ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::trunc);
+      if (!out) return false;
+      out << kIndexHeader << "\n" << std::setprecision(17);
+      for (const auto& kv : records_) {
+        const DicomFileRecord& r = kv.second;
+        const auto loc = locations_.find(r.path);
+        const int z = loc != locations_.end() ? loc->second.z : -1;
+        const size_t n = loc != locations_.end() ? loc->second.series->files.size() : 0;
+        out << r.path << '\t' << r.size << '\t' << r.mtime << '\t' << r.seriesUID << '\t'
+            << r.seriesDetails << '\t' << r.instanceNumber << '\t' << (r.hasGeometry ? 1 : 0);
+        for (double v : r.position) out << '\t' << v;
+        for (double v : r.orientation) out << '\t' << v;
+        out << '\t' << z << '\t' << n << '\n';
+      }
+      if (!out) return false;
+    }
+    fs::rename(tmp, target);
+  } catch (const std::exception&) {
+    return false;
+  }
+  dirty_ = false;
+  return true;
+}
+
+size_t DicomIndex::update(const std::string& dir, bool recursive) {
+  const std::string root = fs::weakly_canonical(dir).string();
+  std::unordered_set<std::string> seen;
+  size_t headersRead = 0;
+  bool changed = false;
+
+  auto visit = [&](const fs::directory_entry& e) {
+    if (!e.is_regular_file()) return;
+    const std::string p = e.path().string();
+    if (p.find_first_of("\t\n") != std::string::npos) return;  // no cabe en el TSV
+    seen.insert(p);
+
+    const std::uint64_t size = e.file_size();
+    const std::int64_t mtime = mtimeOf(e);
+    auto it = records_.find(p);
+    if (it != records_.end() && it->second.size == size && it->second.mtime == mtime) return;
+
+    DicomFileRecord r;
+    if (!readHeader(p, r)) r = DicomFileRecord();  // no DICOM: se registra para no releerlo
+    r.path = p;
+    r.size = size;
+    r.mtime = mtime;
+    records_[p] = std::move(r);
+    ++headersRead;
+    changed = true;
+  };
+  if (recursive) {
+    for (const auto& e : fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied))
+      visit(e);
+  } else {
+    for (const auto& e : fs::directory_iterator(root)) visit(e);
+  }
+
+  // Archivos desaparecidos dentro del ámbito recorrido
+  for (auto it = records_.begin(); it != records_.end();) {
+    const std::string& p = it->first;
+    const bool inScope = recursive ? isUnder(p, root) : fs::path(p).parent_path().string() == root;
+    if (inScope && !seen.count(p)) {
+      it = records_.erase(it);
+      changed = true;
+    } else {
+      ++it;
+    }
+  }
+
+  if (changed) {
+    rebuildSeries();
+    dirty_ = true;
+  }
+  return headersRead;
+}
+
+void DicomIndex::rebuildSeries() {
+  std::unordered_map<std::string, std::vector<const DicomFileRecord*>> groups;
+  for (const auto& kv : records_) {
+    const DicomFileRecord& r = kv.second;
+    if (r.seriesUID.empty()) continue;
+    groups[fs::path(r.path).parent_path().string() + '\t' + r.seriesUID + '\t' + r.seriesDetails].push_back(&r);
+  }
+
+  series_.clear();
+  locations_.clear();
+  for (auto& g : groups) {
+    sortLikeGdcm(g.second);
+    DicomSeriesInfo& info = series_[g.first];
+    info.seriesUID = g.second.front()->seriesUID;
+    info.files.reserve(g.second.size());
+    for (const DicomFileRecord* r : g.second) info.files.push_back(r->path);
+  }
+  // Con series_ ya completo (sus punteros no cambian): archivo -> (serie, Z)
+  for (const auto& kv : series_)
+    for (size_t z = 0; z < kv.second.files.size(); ++z)
+      locations_[kv.second.files[z]] = Location{ &kv.second, (int)z };
+}
+
+std::vector<const DicomSeriesInfo*> DicomIndex::seriesInDirectory(const std::string& dir) const {
+  const std::string prefix = fs::weakly_canonical(dir).string() + '\t';
+  std::vector<const DicomSeriesInfo*> found;
+  for (const auto& kv : series_)
+    if (kv.first.compare(0, prefix.size(), prefix) == 0) found.push_back(&kv.second);
+  return found;
+}
+
+std::string defaultDicomIndexPath() {
+  return (fs::path("outputs/cache") / "dicom_index.tsv").string();
+}
+
+DicomSeriesInfo indexedDicomSeries(const std::string& dicomDir) {
+  static std::mutex m;
+  static DicomIndex index(defaultDicomIndexPath());
+  static bool loaded = false;
+
+  std::lock_guard<std::mutex> lk(m);
+  try {
+    if (!loaded) {
+      index.load();
+      loaded = true;
+    }
+    index.update(dicomDir, false);
+    if (index.dirty() && !index.save())
+      std::cout << "[AVISO] No se pudo guardar el indice DICOM " << index.path() << "\n";
+
+    const auto series = index.seriesInDirectory(dicomDir);
+    if (series.size() == 1) return *series.front();
+  } catch (const std::exception& e) {
+    std::cout << "[AVISO] Indice DICOM: " << e.what() << "\n";
+  }
+  // Varias series (o ninguna) en el directorio: que decida GDCM
+  return findDicomSeries(dicomDir);
+}
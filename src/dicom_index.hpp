@@ -0,0 +1,74 @@
+#pragma once
+#include "itk_loader.hpp"  // DicomSeriesInfo
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Cabecera de un archivo del árbol de datos, leída sin tocar el pixel data.
+struct DicomFileRecord {
+  std::string path;          // canónica
+  std::uint64_t size = 0;
+  std::int64_t mtime = 0;
+  std::string seriesUID;     // vacío: no es DICOM (no se relee mientras no cambie)
+  // Lo que GDCMSeriesFileNames (SetUseSeriesDetails) añade al UID para separar
+  // series: número de serie, secuencia, grosor de corte, filas y columnas
+  std::string seriesDetails;
+  int instanceNumber = 0;
+  bool hasGeometry = false;  // posición y orientación presentes
+  double position[3] = {0.0, 0.0, 0.0};                  // ImagePositionPatient
+  double orientation[6] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0}; // ImageOrientationPatient
+};
+
+// Índice persistente de archivos DICOM (TSV en disco). update() solo relee la
+// cabecera de los archivos nuevos o cuyo tamaño/mtime ha cambiado. Las series
+// se agrupan y se ordenan en Z como findDicomSeries: UID más los detalles de
+// serie, y orden por posición sobre la normal del corte (si se repite, número
+// de instancia; si no, nombre). El TSV guarda además el índice Z de cada
+// archivo en su serie.
+class DicomIndex {
+public:
+  explicit DicomIndex(std::string indexPath);
+
+  // Lee el índice guardado; sin archivo (o ilegible) empieza vacío.
+  void load();
+  // Escribe el índice (temporal + rename). false si no se pudo.
+  bool save();
+
+  // Sincroniza los archivos de dir (y subdirectorios si recursive) con el
+  // disco. Devuelve cuántas cabeceras se han leído.
+  size_t update(const std::string& dir, bool recursive = true);
+  // ¿Hay cambios sin guardar?
+  bool dirty() const { return dirty_; }
+
+  // Series cuyos archivos están directamente en dir.
+  std::vector<const DicomSeriesInfo*> seriesInDirectory(const std::string& dir) const;
+
+  size_t numFiles() const { return records_.size(); }
+  size_t numSeries() const { return series_.size(); }
+  const std::string& path() const { return path_; }
+
+private:
+  void rebuildSeries();
+
+  struct Location {
+    const DicomSeriesInfo* series = nullptr;  // archivos en orden Z
+    int z = -1;
+  };
+
+  std::string path_;
+  std::unordered_map<std::string, DicomFileRecord> records_;  // por ruta canónica
+  // Serie = (directorio, UID, detalles); las claves son "directorio\tUID\tdetalles"
+  std::unordered_map<std::string, DicomSeriesInfo> series_;
+  std::unordered_map<std::string, Location> locations_;       // por ruta canónica (columna Z de save)
+  bool dirty_ = false;
+};
+
+// outputs/cache/dicom_index.tsv, junto a los volúmenes .huv
+std::string defaultDicomIndexPath();
+
+// Serie de un directorio a través del índice del proceso (se actualiza ese
+// directorio y se guarda si cambió). Si el directorio tiene más de una serie
+// o ninguna, recurre al descubrimiento de GDCM (findDicomSeries).
+DicomSeriesInfo indexedDicomSeries(const std::string& dicomDir);
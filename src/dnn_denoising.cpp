@@ -3,12 +3,76 @@
 #include <opencv2/dnn.hpp>
 #include <opencv2/core.hpp>
 #include <iostream>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
 
 using namespace cv;
 using namespace std;
 
+namespace {
+
+// HU → [0, 1] con la escala de la ventana, recortado al dominio de entrenamiento
+Mat huToUnit(const Mat& hu32f, HUNormalization norm) {
+    const float width = std::max(1e-6f, norm.width);
+    const float low = norm.center - norm.width * 0.5f;
+    Mat unit;
+    hu32f.convertTo(unit, CV_32F, 1.0 / width, -low / width);
+    cv::max(unit, 0.0, unit);
+    cv::min(unit, 1.0, unit);
+    return unit;
+}
+
+// SSIM medio (Wang et al. 2004: gaussiana 11x11, sigma 1.5) de dos imágenes
+// CV_32F en [0, 1].
+double meanSSIM(const Mat& a, const Mat& b) {
+    const double C1 = 0.01 * 0.01, C2 = 0.03 * 0.03;
+    const Size win(11, 11);
+    const double sigma = 1.5;
+
+    Mat muA, muB, sAA, sBB, sAB;
+    GaussianBlur(a, muA, win, sigma);
+    GaussianBlur(b, muB, win, sigma);
+    GaussianBlur(a.mul(a), sAA, win, sigma);
+    GaussianBlur(b.mul(b), sBB, win, sigma);
+    GaussianBlur(a.mul(b), sAB, win, sigma);
+
+    const Mat muAA = muA.mul(muA), muBB = muB.mul(muB), muAB = muA.mul(muB);
+    sAA -= muAA;
+    sBB -= muBB;
+    sAB -= muAB;
+
+    Mat num = (2 * muAB + C1).mul(2 * sAB + C2);
+    Mat den = (muAA + muBB + C1).mul(sAA + sBB + C2);
+    Mat map;
+    divide(num, den, map);
+    return mean(map)[0];
+}
+
+// Red cuantizada a partir de una FP32 ya cargada
+dnn::Net quantizedCopy(dnn::Net& fp32, const vector<Mat>& calibBlobs) {
+    dnn::Net q = fp32.quantize(calibBlobs, CV_32F, CV_32F);
+    q.setPreferableBackend(dnn::DNN_BACKEND_OPENCV);
+    q.setPreferableTarget(dnn::DNN_TARGET_CPU);
+    return q;
+}
+
+} // namespace
+
+DnnPrecision parseDnnPrecision(const std::string& name) {
+    if (name == "fp32" || name == "FP32") return DnnPrecision::FP32;
+    if (name == "int8" || name == "INT8") return DnnPrecision::INT8;
+    throw std::runtime_error("Precisión DnCNN desconocida (fp32|int8): " + name);
+}
+
 // Constructor
-DnnDenoiser::DnnDenoiser(const std::string& modelPath) {
+DnnDenoiser::DnnDenoiser(const std::string& modelPath)
+    : modelLoaded(false), modelPath(modelPath) {
     // Intentar cargar la red. Si el archivo es incompatible, esto lanzará una excepción
     // que será atrapada en el main.
     net = dnn::readNetFromONNX(modelPath);
@@ -20,38 +84,324 @@ DnnDenoiser::DnnDenoiser(const std::string& modelPath) {
     // Configurar backend preferido (CPU es más seguro para compatibilidad)
     net.setPreferableBackend(dnn::DNN_BACKEND_OPENCV);
     net.setPreferableTarget(dnn::DNN_TARGET_CPU);
+    modelLoaded = true;
+}
+
+Mat DnnDenoiser::forward(const Mat& blob) {
+    dnn::Net& active = activeNet();
+    active.setInput(blob);
+    return active.forward(); // La red DnCNN predice el RUIDO
 }
 
 // Método Denoise
 Mat DnnDenoiser::denoise(const Mat& noisy8u) {
-    if (net.empty()) return noisy8u.clone();
+    return denoiseBatch({ noisy8u }).front();
+}
+
+// Ruido predicho para N entradas [0,1] CV_32F del mismo tamaño. Los planos
+// devueltos son vistas sobre el blob de salida de la red (válidas hasta el
+// siguiente forward).
+vector<Mat> DnnDenoiser::predictResiduals(const vector<Mat>& inputs) {
+    vector<Mat> residuals(inputs.size());
+
+    // Imágenes grandes: por teselas, una a una (memoria acotada)
+    if (useTiling(inputs.front().size())) {
+        for (size_t i = 0; i < inputs.size(); ++i) residuals[i] = residualTiled(inputs[i]);
+        return residuals;
+    }
+
+    // 2. Crear Blob (N, C, H, W) con todo el lote
+    Mat blob = dnn::blobFromImages(inputs);
+
+    // 3. Inferencia (un solo forward para los N slices)
+    Mat residual_blob = forward(blob);
+
+    // 4. Postprocesamiento: el plano i del blob [N, 1, H, W] como Mat 2D [H, W]
+    const int H = residual_blob.size[2];
+    Mat planes = residual_blob.reshape(1, (int)inputs.size() * H);  // [N*H, W], comparte datos
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        residuals[i] = planes.rowRange((int)i * H, (int)(i + 1) * H);
+    }
+    return residuals;
+}
+
+// Método Denoise por lotes
+vector<Mat> DnnDenoiser::denoiseBatch(const vector<Mat>& noisy8u) {
+    vector<Mat> results(noisy8u.size());
+    if (noisy8u.empty()) return results;
+    if (net.empty()) {
+        for (size_t i = 0; i < noisy8u.size(); ++i) results[i] = noisy8u[i].clone();
+        return results;
+    }
+
+    const Size sz = noisy8u.front().size();
     
     // 1. Convertir a Float [0, 1]
-    Mat input_mat;
-    noisy8u.convertTo(input_mat, CV_32F, 1.0 / 255.0);
+    vector<Mat> inputs(noisy8u.size());
+    for (size_t i = 0; i < noisy8u.size(); ++i) {
+        CV_Assert(noisy8u[i].size() == sz && noisy8u[i].channels() == 1);
+        noisy8u[i].convertTo(inputs[i], CV_32F, 1.0 / 255.0);
+    }
 
-    // 2. Crear Blob (N, C, H, W)
-    Mat blob = dnn::blobFromImage(input_mat); 
+    vector<Mat> residuals = predictResiduals(inputs);
 
-    // 3. Inferencia
-    net.setInput(blob);
-    Mat residual_blob = net.forward(); // La red DnCNN predice el RUIDO
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        // 5. APRENDIZAJE RESIDUAL: Imagen Limpia = Entrada - Ruido Predicho
+        Mat output_mat;
+        subtract(inputs[i], residuals[i], output_mat);
 
-    // 4. Postprocesamiento: Convertir blob a Mat 2D
-    // El blob tiene dimensiones [1, 1, H, W]. Lo convertimos a [H, W]
-    std::vector<int> sizes = {residual_blob.size[2], residual_blob.size[3]};
-    Mat residual_mat(2, sizes.data(), CV_32F, residual_blob.ptr<float>());
+        // 6. Conversión a 8-bit (convertTo satura a [0, 255]: hace el clamping)
+        output_mat.convertTo(results[i], CV_8U, 255.0);
+    }
+    return results;
+}
 
-    // 5. APRENDIZAJE RESIDUAL: Imagen Limpia = Entrada - Ruido Predicho
-    Mat output_mat;
-    subtract(input_mat, residual_mat, output_mat);
+Mat DnnDenoiser::denoiseHU(const Mat& hu32f, HUNormalization norm) {
+    return denoiseBatchHU({ hu32f }, norm).front();
+}
 
-    // 6. Clamping y conversión a 8-bit
-    output_mat.setTo(0.0f, output_mat < 0.0f);
-    output_mat.setTo(1.0f, output_mat > 1.0f);
-    
-    Mat denoised8u;
-    output_mat.convertTo(denoised8u, CV_8U, 255.0);
+// Método Denoise en HU: sin cuantización a 8 bits
+vector<Mat> DnnDenoiser::denoiseBatchHU(const vector<Mat>& hu32f, HUNormalization norm) {
+    vector<Mat> results(hu32f.size());
+    if (hu32f.empty()) return results;
+    if (net.empty()) {
+        for (size_t i = 0; i < hu32f.size(); ++i) results[i] = hu32f[i].clone();
+        return results;
+    }
+
+    const Size sz = hu32f.front().size();
+    const float width = std::max(1e-6f, norm.width);
+    const float low = norm.center - norm.width * 0.5f;
+    const float high = low + norm.width;
+
+    // 1. HU → [0, 1] con la escala de la ventana
+    vector<Mat> inputs(hu32f.size());
+    for (size_t i = 0; i < hu32f.size(); ++i) {
+        CV_Assert(hu32f[i].type() == CV_32F && hu32f[i].size() == sz);
+        inputs[i] = huToUnit(hu32f[i], norm);
+    }
 
-    return denoised8u;
-}
\ No newline at end of file
+    vector<Mat> residuals = predictResiduals(inputs);
+
+    // 2. HU limpio = HU - ruido * ancho, solo dentro de la ventana: fuera, la
+    // entrada de la red estaba recortada a 0 o 1 y lo que predice no es el
+    // ruido del píxel, así que el HU se conserva (una sola pasada, en float)
+    for (size_t i = 0; i < hu32f.size(); ++i) {
+        results[i].create(sz, CV_32F);
+        for (int y = 0; y < sz.height; ++y) {
+            const float* h = hu32f[i].ptr<float>(y);
+            const float* r = residuals[i].ptr<float>(y);
+            float* d = results[i].ptr<float>(y);
+            for (int x = 0; x < sz.width; ++x)
+                d[x] = (h[x] >= low && h[x] <= high) ? h[x] - r[x] * width : h[x];
+        }
+    }
+    return results;
+}
+
+bool DnnDenoiser::useTiling(const Size& size) const {
+    return tiling.tileSize > 0 && (size.width > tiling.tileSize || size.height > tiling.tileSize);
+}
+
+Mat DnnDenoiser::residualTiled(const Mat& input) {
+    const int tile = tiling.tileSize;
+    const int halo = std::max(0, tiling.overlap);
+
+    // Rejilla de teselas: núcleo (lo que se conserva) + halo recortado a la imagen
+    vector<Rect> cores;
+    for (int y = 0; y < input.rows; y += tile)
+        for (int x = 0; x < input.cols; x += tile)
+            cores.emplace_back(x, y, std::min(tile, input.cols - x), std::min(tile, input.rows - y));
+
+    unsigned nThreads = tiling.threads > 0 ? (unsigned)tiling.threads
+                                           : std::max(1u, std::thread::hardware_concurrency());
+    nThreads = std::min<unsigned>(nThreads, (unsigned)cores.size());
+
+    // Una red por hilo (en la precisión activa); se cargan la primera vez y se reutilizan
+    while (tileNets.size() < nThreads) {
+        dnn::Net n = dnn::readNetFromONNX(modelPath);
+        n.setPreferableBackend(dnn::DNN_BACKEND_OPENCV);
+        n.setPreferableTarget(dnn::DNN_TARGET_CPU);
+        if (precision == DnnPrecision::INT8) n = quantizedCopy(n, calibBlobs);
+        tileNets.push_back(n);
+    }
+
+    Mat residual(input.size(), CV_32F);
+    const Rect bounds(0, 0, input.cols, input.rows);
+    atomic<size_t> next{0};
+    exception_ptr error;
+    mutex errorMutex;
+
+    // El paralelismo va por teselas. No se cambia cv::setNumThreads (global y
+    // compartido con otros denoisers): el pool de OpenCV atiende un parallel_for_
+    // a la vez y los forward concurrentes de otros hilos corren en su propio hilo
+    auto worker = [&](unsigned t) {
+        try {
+            for (size_t i = next++; i < cores.size(); i = next++) {
+                const Rect core = cores[i];
+                const Rect padded = Rect(core.x - halo, core.y - halo,
+                                         core.width + 2 * halo, core.height + 2 * halo) & bounds;
+
+                tileNets[t].setInput(dnn::blobFromImage(input(padded)));
+                Mat out = tileNets[t].forward();
+                Mat outTile(out.size[2], out.size[3], CV_32F, out.ptr<float>());
+
+                outTile(Rect(core.tl() - padded.tl(), core.size())).copyTo(residual(core));
+            }
+        } catch (...) {
+            lock_guard<mutex> lk(errorMutex);
+            if (!error) error = current_exception();
+            next = cores.size();  // que el resto de hilos terminen
+        }
+    };
+    vector<thread> workers;
+    for (unsigned t = 1; t < nThreads; ++t) workers.emplace_back(worker, t);
+    worker(0);
+    for (auto& w : workers) w.join();
+
+    if (error) rethrow_exception(error);
+    return residual;
+}
+
+QuantizationReport DnnDenoiser::quantizeInt8(const vector<Mat>& calibrationHU,
+                                             const vector<Mat>& validationHU,
+                                             const QuantizationGuard& guard, HUNormalization norm) {
+    QuantizationReport r;
+    r.calibrationSlices = (int)calibrationHU.size();
+    r.validationSlices = (int)validationHU.size();
+    if (net.empty() || calibrationHU.empty()) {
+        r.reason = "sin red o sin slices de calibracion";
+        return r;
+    }
+
+    // 1. Calibración: un blob [1,1,H,W] por slice, normalizado como en denoiseBatchHU
+    setPrecision(DnnPrecision::FP32);
+    calibBlobs.clear();
+    for (const Mat& hu : calibrationHU) {
+        CV_Assert(hu.type() == CV_32F);
+        calibBlobs.push_back(dnn::blobFromImage(huToUnit(hu, norm)));
+    }
+    try {
+        int8Net = quantizedCopy(net, calibBlobs);
+    } catch (const cv::Exception& e) {
+        int8Net = dnn::Net();
+        r.reason = string("la cuantizacion fallo: ") + e.what();
+        return r;
+    }
+
+    if (validationHU.empty()) {
+        setPrecision(DnnPrecision::INT8);
+        r.accepted = true;
+        return r;
+    }
+
+    // 2. Guardas: salida limpia de cada precisión en la escala de la red, recortada a [0,1]
+    r.validated = true;
+    r.psnr = std::numeric_limits<double>::infinity();
+    r.ssim = 1.0;
+    TickMeter t32, t8;
+    for (size_t i = 0; i < validationHU.size(); ++i) {
+        CV_Assert(validationHU[i].type() == CV_32F);
+        const Mat input = huToUnit(validationHU[i], norm);
+        const Mat blob = dnn::blobFromImage(input);
+        if (i == 0) {  // el primer forward de cada red inicializa capas: fuera de la medida
+            setPrecision(DnnPrecision::FP32);
+            forward(blob);
+            setPrecision(DnnPrecision::INT8);
+            forward(blob);
+        }
+
+        Mat clean[2];
+        TickMeter* timers[2] = { &t32, &t8 };
+        const DnnPrecision modes[2] = { DnnPrecision::FP32, DnnPrecision::INT8 };
+        for (int k = 0; k < 2; ++k) {
+            setPrecision(modes[k]);
+            timers[k]->start();
+            Mat out = forward(blob);
+            timers[k]->stop();
+            const Mat residual(out.size[2], out.size[3], CV_32F, out.ptr<float>());
+            subtract(input, residual, clean[k]);
+            cv::max(clean[k], 0.0, clean[k]);
+            cv::min(clean[k], 1.0, clean[k]);
+        }
+        r.psnr = std::min(r.psnr, PSNR(clean[0], clean[1], 1.0));
+        r.ssim = std::min(r.ssim, meanSSIM(clean[0], clean[1]));
+    }
+    r.fp32Ms = t32.getTimeMilli() / validationHU.size();
+    r.int8Ms = t8.getTimeMilli() / validationHU.size();
+
+    r.accepted = r.psnr >= guard.minPSNR && r.ssim >= guard.minSSIM;
+    if (!r.accepted) r.reason = "no supera las guardas de PSNR/SSIM";
+    setPrecision(r.accepted ? DnnPrecision::INT8 : DnnPrecision::FP32);
+    return r;
+}
+
+void DnnDenoiser::setPrecision(DnnPrecision p) {
+    if (p == DnnPrecision::INT8 && int8Net.empty())
+        CV_Error(Error::StsError, "INT8 sin cuantizar: llamar antes a quantizeInt8");
+    if (p != precision) tileNets.clear();  // se recrean en la nueva precisión
+    precision = p;
+}
+
+void DnnDenoiser::warmUp(const Size& size, int batchSize) {
+    if (net.empty()) return;
+    if (useTiling(size)) {  // las teselas van de una en una: el lote no cuenta
+        residualTiled(Mat::zeros(size, CV_32F));
+        return;
+    }
+    const int shape[4] = { std::max(1, batchSize), 1, size.height, size.width };
+    Mat blob(4, shape, CV_32F, Scalar(0));
+    forward(blob);
+}
+
+void splitCalibration(const vector<Mat>& slicesHU, vector<Mat>& calibrationHU, vector<Mat>& validationHU) {
+    calibrationHU.clear();
+    validationHU.clear();
+    for (size_t i = 0; i < slicesHU.size(); ++i)
+        (i % 2 == 0 ? calibrationHU : validationHU).push_back(slicesHU[i]);
+}
+
+void printQuantizationReport(const QuantizationReport& r, const QuantizationGuard& guard) {
+    cout << "[DNN] INT8 calibrada con " << r.calibrationSlices << " slices";
+    if (r.validated) {
+        cout << ", validada con " << r.validationSlices << ": PSNR " << r.psnr << " dB (minimo "
+             << guard.minPSNR << "), SSIM " << r.ssim << " (minimo " << guard.minSSIM << ")\n"
+             << "[DNN] Forward por slice: FP32 " << r.fp32Ms << " ms, INT8 " << r.int8Ms << " ms (x"
+             << (r.int8Ms > 0 ? r.fp32Ms / r.int8Ms : 0.0) << ")";
+    }
+    cout << "\n";
+    if (r.accepted) cout << "[DNN] Precision activa: INT8\n";
+    else cout << "[AVISO] INT8 descartada (" << r.reason << "): DnCNN sigue en FP32\n";
+}
+
+DnnThreadsScope::DnnThreadsScope(int threads) : previous(-1) {
+    if (threads <= 0) return;
+    previous = cv::getNumThreads();
+    cv::setNumThreads(threads);
+}
+
+DnnThreadsScope::~DnnThreadsScope() {
+    if (previous >= 0) cv::setNumThreads(previous);
+}
+
+DnnDenoiser* sharedDnnDenoiser(const std::string& modelPath) {
+    static mutex m;
+    static unique_ptr<DnnDenoiser> instance;
+    static string loadedPath;
+    static bool failed = false;
+
+    lock_guard<mutex> lk(m);
+    if (loadedPath != modelPath) {
+        instance.reset();
+        failed = false;
+        loadedPath = modelPath;
+    }
+    if (!instance && !failed) {
+        try {
+            instance = make_unique<DnnDenoiser>(modelPath);
+        } catch (...) {
+            failed = true;
+        }
+    }
+    return instance.get();
+}
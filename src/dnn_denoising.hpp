@@ -4,21 +4,154 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/dnn.hpp>
 #include <string>
+#include <vector>
 #include <iostream>
 
+// Inferencia por teselas: cada tesela de tileSize x tileSize se procesa con un
+// halo de `overlap` píxeles que luego se descarta. DnCNN (17 capas conv 3x3)
+// tiene un campo receptivo de radio 17, así que con overlap >= 17 el resultado
+// coincide con el de la imagen completa salvo redondeo float (|diff| < 1e-4 en
+// escala [0,1], es decir, < 0.03 niveles de gris; kTileMaxAbsDiff, comprobable
+// con --dnn-check) y no hay costuras.
+// La memoria pico queda acotada por threads x (tileSize + 2*overlap)^2.
+struct TileOptions {
+    int tileSize = 0;    // 0 = desactivado (imagen completa)
+    int overlap = 17;    // halo por lado, en píxeles
+    int threads = 0;     // 0 = hardware_concurrency()
+};
+
+// Diferencia máxima admitida entre teselas e imagen completa, en escala [0,1].
+constexpr double kTileMaxAbsDiff = 1e-4;
+
+// Escala HU ↔ [0,1] de la red: la misma que el ventaneo center/width, de
+// modo que el nivel de ruido que ve la red es el del camino de 8 bits.
+struct HUNormalization {
+    float center = 40.0f;
+    float width = 400.0f;
+};
+
+// Precisión de la inferencia. INT8 es la red FP32 cuantizada en memoria con
+// cv::dnn::Net::quantize (pesos por canal, activaciones calibradas con slices
+// reales); la red FP32 se conserva para poder volver a ella.
+enum class DnnPrecision { FP32, INT8 };
+
+// "fp32" / "int8" -> DnnPrecision. Lanza std::runtime_error si no la reconoce.
+DnnPrecision parseDnnPrecision(const std::string& name);
+
+// Guardas para aceptar INT8: la salida limpia de INT8 frente a la de FP32, en
+// la escala [0,1] de la red (la ventana de HUNormalization), en el peor slice
+// de validación.
+struct QuantizationGuard {
+    double minPSNR = 40.0;  // dB
+    double minSSIM = 0.98;
+};
+
+struct QuantizationReport {
+    bool accepted = false;      // INT8 activa tras la llamada
+    bool validated = false;     // se midieron PSNR/SSIM
+    double psnr = 0.0;          // dB, peor slice
+    double ssim = 0.0;          // peor slice
+    double fp32Ms = 0.0;        // forward medio por slice
+    double int8Ms = 0.0;
+    int calibrationSlices = 0;
+    int validationSlices = 0;
+    std::string reason;         // por qué se rechazó (vacío si se aceptó)
+};
+
 class DnnDenoiser {
 public:
-    // Constructor: Carga el modelo ONNX desde la ruta especificada
-    DnnDenoiser(const std::string& modelPath);
+    // Constructor: Carga el modelo ONNX desde la ruta especificada.
+    // Los hilos de OpenCV (cv::setNumThreads, global) no se tocan aquí: los fija
+    // el modo que ejecuta los forward con DnnThreadsScope.
+    explicit DnnDenoiser(const std::string& modelPath);
 
     // Método principal para limpiar la imagen
     // input: Imagen en escala de grises (CV_8U o CV_32F)
     // return: Imagen limpia (denoised)
     cv::Mat denoise(const cv::Mat& inputImage);
 
+    // Lote: N slices del mismo tamaño → un blob [N,1,H,W] (blobFromImages)
+    // y un único forward. Devuelve las N imágenes limpias en el mismo orden.
+    std::vector<cv::Mat> denoiseBatch(const std::vector<cv::Mat>& inputImages);
+
+    // Camino nativo en HU: entrada y salida CV_32F en HU reales. La normalización
+    // se hace dentro; la entrada de la red se recorta a [0,1] y el ruido predicho
+    // se resta del HU original solo en los píxeles dentro de la ventana de norm:
+    // fuera (aire, hueso denso con la ventana de partes blandas) el HU se conserva.
+    cv::Mat denoiseHU(const cv::Mat& hu32f, HUNormalization norm = HUNormalization());
+    std::vector<cv::Mat> denoiseBatchHU(const std::vector<cv::Mat>& hu32f,
+                                        HUNormalization norm = HUNormalization());
+
+    // Forward de calentamiento: inicializa capas y reserva la memoria interna
+    // para ese tamaño/lote, de modo que el primer slice real no lo pague. Con
+    // teselas se calientan las redes de teselas con un slice vacío (nunca un
+    // forward de la imagen completa, que es la memoria que las teselas acotan).
+    void warmUp(const cv::Size& size, int batchSize = 1);
+
+    // Cuantiza la red a INT8 calibrando las activaciones con calibrationHU
+    // (slices en HU, CV_32F) y compara INT8 con FP32 sobre validationHU. INT8
+    // queda activa solo si cumple las guardas; si no (o si la cuantización
+    // falla) se sigue en FP32. Con validationHU vacío se acepta sin medir,
+    // p.ej. en las copias por hilo de un denoiser ya validado.
+    QuantizationReport quantizeInt8(const std::vector<cv::Mat>& calibrationHU,
+                                    const std::vector<cv::Mat>& validationHU,
+                                    const QuantizationGuard& guard = QuantizationGuard(),
+                                    HUNormalization norm = HUNormalization());
+
+    // INT8 requiere una quantizeInt8 previa.
+    void setPrecision(DnnPrecision p);
+    DnnPrecision getPrecision() const { return precision; }
+    bool hasInt8() const { return !int8Net.empty(); }
+
+    // Activa la inferencia por teselas para imágenes mayores que una tesela.
+    void setTiling(const TileOptions& opt) { tiling = opt; }
+    const TileOptions& getTiling() const { return tiling; }
+
 private:
+    cv::Mat forward(const cv::Mat& blob);
+    cv::dnn::Net& activeNet() { return precision == DnnPrecision::INT8 ? int8Net : net; }
+    std::vector<cv::Mat> predictResiduals(const std::vector<cv::Mat>& inputs32f);
+    // Ruido predicho para una imagen [0,1] CV_32F, por teselas en paralelo.
+    cv::Mat residualTiled(const cv::Mat& input32f);
+    bool useTiling(const cv::Size& size) const;
+
     cv::dnn::Net net;
+    cv::dnn::Net int8Net;                // vacía hasta quantizeInt8
+    std::vector<cv::Mat> calibBlobs;     // para cuantizar también las redes de teselas
+    DnnPrecision precision = DnnPrecision::FP32;
     bool modelLoaded;
+    std::string modelPath;
+    TileOptions tiling;
+    std::vector<cv::dnn::Net> tileNets;  // una red por hilo de teselas (Net no es reentrante)
 };
 
-#endif // DNN_DENOISER_HPP
\ No newline at end of file
+// Reparte slices para quantizeInt8: las pares calibran y las impares validan
+// (así la validación no usa las slices de la calibración).
+void splitCalibration(const std::vector<cv::Mat>& slicesHU, std::vector<cv::Mat>& calibrationHU,
+                      std::vector<cv::Mat>& validationHU);
+
+// Resumen de una cuantización en la consola ([DNN] ...).
+void printQuantizationReport(const QuantizationReport& r, const QuantizationGuard& guard = QuantizationGuard());
+
+// Hilos de OpenCV de los forward DnCNN durante un modo (batch, interactivo,
+// comprobaciones). cv::setNumThreads es global del proceso: se fija una sola
+// vez al empezar el modo, antes de lanzar los hilos que hacen forward, y se
+// restaura al salir del ámbito; nunca alrededor de cada forward, donde los
+// denoisers de otros hilos se lo pisarían. threads <= 0 no cambia nada.
+class DnnThreadsScope {
+public:
+    explicit DnnThreadsScope(int threads);
+    ~DnnThreadsScope();
+
+    DnnThreadsScope(const DnnThreadsScope&) = delete;
+    DnnThreadsScope& operator=(const DnnThreadsScope&) = delete;
+
+private:
+    int previous;  // -1: no se cambió
+};
+
+// Denoiser de proceso: el modelo se carga una sola vez y se reutiliza entre
+// peticiones. Devuelve nullptr si el modelo no se pudo cargar.
+DnnDenoiser* sharedDnnDenoiser(const std::string& modelPath);
+
+#endif // DNN_DENOISER_HPP
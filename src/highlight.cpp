@@ -1,83 +1,152 @@
 #include "highlight.hpp"
+#include "morphology.hpp"
+#include "buffer_pool.hpp"
 #include <opencv2/imgproc.hpp>
 #include <iostream>
+#include <algorithm>
 
 using namespace cv;
 
 // ==========================================================
-// IMPLEMENTACIÓN PURA (Sin suavizado interno)
+// CLASIFICACIÓN FUSIONADA (Sin suavizado interno)
 // ==========================================================
-AnatomyMasks generateAnatomicalMasksHU(const Mat& huInput) {
-    AnatomyMasks m;
+void thresholdTissuesHU(const Mat& huInput, const TissueThresholds& t, Mat& fat, Mat& muscle, Mat& bones) {
+    CV_Assert(huInput.type() == CV_32F);
+    fat.create(huInput.size(), CV_8U);
+    muscle.create(huInput.size(), CV_8U);
+    bones.create(huInput.size(), CV_8U);
+    for (int y = 0; y < huInput.rows; ++y) {
+        const float* h = huInput.ptr<float>(y);
+        uchar* f = fat.ptr<uchar>(y);
+        uchar* m = muscle.ptr<uchar>(y);
+        uchar* b = bones.ptr<uchar>(y);
+        for (int x = 0; x < huInput.cols; ++x) {
+            const float v = h[x];
+            f[x] = (v >= t.fatMin && v <= t.fatMax) ? 255 : 0;
+            m[x] = (v >= t.muscleMin && v <= t.muscleMax) ? 255 : 0;
+            b[x] = (v >= t.boneMin) ? 255 : 0;
+        }
+    }
+}
 
-    // Usamos directamente la matriz de entrada (sea cruda o suavizada)
-    // Rangos de HU estándar
-    Mat raw_fat    = (huInput >= -190.f) & (huInput <= -30.f);
-    Mat raw_muscle = (huInput >= 10.f)   & (huInput <= 120.f);
-    Mat raw_bone   = (huInput >= 200.f);
+void resolveTissueHierarchy(const Mat& fat, const Mat& muscle, const Mat& bones, Mat& labels) {
+    CV_Assert(fat.type() == CV_8U && fat.size() == muscle.size() && fat.size() == bones.size());
+    labels.create(fat.size(), CV_8U);
+    for (int y = 0; y < labels.rows; ++y) {
+        const uchar* f = fat.ptr<uchar>(y);
+        const uchar* m = muscle.ptr<uchar>(y);
+        const uchar* b = bones.ptr<uchar>(y);
+        uchar* l = labels.ptr<uchar>(y);
+        for (int x = 0; x < labels.cols; ++x) {
+            l[x] = b[x] ? TISSUE_BONE : m[x] ? TISSUE_MUSCLE : f[x] ? TISSUE_FAT : TISSUE_NONE;
+        }
+    }
+}
 
-    // Convertir a 8-bit
-    raw_fat.convertTo(m.fat, CV_8U, 255);
-    raw_muscle.convertTo(m.muscle_tendon, CV_8U, 255);
-    raw_bone.convertTo(m.bones, CV_8U, 255);
+Mat generateTissueLabelsHU(const Mat& huInput, const TissueThresholds& t) {
+    // 1. Una sola lectura del HU: las tres máscaras crudas (0/255) a la vez.
+    // Todos los buffers salen del pool del hilo (se reutilizan entre slices)
+    BufferPool& pool = threadBufferPool();
+    Mat fat = pool.acquire(huInput.size(), CV_8U);
+    Mat muscle = pool.acquire(huInput.size(), CV_8U);
+    Mat bones = pool.acquire(huInput.size(), CV_8U);
+    thresholdTissuesHU(huInput, t, fat, muscle, bones);
 
-    // Mantenemos la limpieza morfológica (para unir regiones), 
+    // 2. Mantenemos la limpieza morfológica (para unir regiones), 
     // pero si la entrada es muy ruidosa, esto no será suficiente para arreglarla.
     Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(3, 3));
     Mat kernelLg = getStructuringElement(MORPH_ELLIPSE, Size(5, 5));
 
-    morphologyEx(m.bones, m.bones, MORPH_CLOSE, kernel);
+    // Mismo resultado que morphologyEx, con los temporales en el pool
+    morphCloseFast(bones, bones, kernel);
 
-    morphologyEx(m.muscle_tendon, m.muscle_tendon, MORPH_OPEN, kernel);
-    morphologyEx(m.muscle_tendon, m.muscle_tendon, MORPH_CLOSE, kernelLg);
+    morphOpenFast(muscle, muscle, kernel);
+    morphCloseFast(muscle, muscle, kernelLg);
 
-    morphologyEx(m.fat, m.fat, MORPH_OPEN, kernel);
+    morphOpenFast(fat, fat, kernel);
 
-    // Jerarquía
-    m.muscle_tendon.setTo(0, m.bones);
-    m.fat.setTo(0, m.muscle_tendon);
-    m.fat.setTo(0, m.bones);
+    // 3. Jerarquía resuelta en línea al escribir el mapa de etiquetas
+    Mat labels = pool.acquire(huInput.size(), CV_8U);
+    resolveTissueHierarchy(fat, muscle, bones, labels);
+    return labels;
+}
 
+AnatomyMasks masksFromLabels(const Mat& labels) {
+    CV_Assert(labels.type() == CV_8U);
+    // Máscaras del pool del hilo: compare escribe en ellas sin reservar
+    BufferPool& pool = threadBufferPool();
+    AnatomyMasks m;
+    m.labels = labels;
+    m.fat = pool.acquire(labels.size(), CV_8U);
+    m.muscle_tendon = pool.acquire(labels.size(), CV_8U);
+    m.bones = pool.acquire(labels.size(), CV_8U);
+    compare(labels, Scalar(TISSUE_FAT), m.fat, CMP_EQ);
+    compare(labels, Scalar(TISSUE_MUSCLE), m.muscle_tendon, CMP_EQ);
+    compare(labels, Scalar(TISSUE_BONE), m.bones, CMP_EQ);
     return m;
 }
 
+AnatomyMasks generateAnatomicalMasksHU(const Mat& huInput, const TissueThresholds& t) {
+    return masksFromLabels(generateTissueLabelsHU(huInput, t));
+}
+
 // ==========================================================
-// IMPLEMENTACIÓN DE colorizeAndOverlay (Se mantiene igual)
+// SUPERPOSICIÓN EN UNA PASADA (etiqueta → color/alpha)
 // ==========================================================
-Mat colorizeAndOverlay(const Mat& slice8u, const AnatomyMasks& m) {
-    Mat base_bgr;
-    if (slice8u.channels() == 1) cvtColor(slice8u, base_bgr, COLOR_GRAY2BGR); 
-    else base_bgr = slice8u.clone();
-
-    // Hueso: CYAN BRILLANTE
-    const Scalar COLOR_BONE = Scalar(255, 255, 0); 
-    // Músculo: MAGENTA / ROSA
-    const Scalar COLOR_MUSCLE = Scalar(128, 0, 255); 
-    // Grasa: AMARILLO LIMA
-    const Scalar COLOR_FAT = Scalar(0, 255, 255); 
-
-    Mat colored_fat = Mat::zeros(base_bgr.size(), base_bgr.type());
-    colored_fat.setTo(COLOR_FAT, m.fat);
-
-    Mat colored_muscle = Mat::zeros(base_bgr.size(), base_bgr.type());
-    colored_muscle.setTo(COLOR_MUSCLE, m.muscle_tendon);
-
-    Mat colored_bone = Mat::zeros(base_bgr.size(), base_bgr.type());
-    colored_bone.setTo(COLOR_BONE, m.bones);
-
-    Mat final_overlay = base_bgr.clone();
-
+OverlayPalette defaultOverlayPalette() {
+    OverlayPalette p;
+    p.color[TISSUE_NONE]   = Vec3b(0, 0, 0);
+    p.color[TISSUE_FAT]    = Vec3b(0, 255, 255);   // Grasa: AMARILLO LIMA
+    p.color[TISSUE_MUSCLE] = Vec3b(128, 0, 255);   // Músculo: MAGENTA / ROSA
+    p.color[TISSUE_BONE]   = Vec3b(255, 255, 0);   // Hueso: CYAN BRILLANTE
     // Transparencia
-    double alpha = 0.60; 
-    
-    if (countNonZero(m.fat) > 0)
-        addWeighted(final_overlay, 1.0, colored_fat, alpha, 0, final_overlay);
-        
-    if (countNonZero(m.muscle_tendon) > 0)
-        addWeighted(final_overlay, 1.0, colored_muscle, alpha, 0, final_overlay);
-        
-    if (countNonZero(m.bones) > 0)
-        addWeighted(final_overlay, 1.0, colored_bone, alpha, 0, final_overlay);
+    p.alpha[TISSUE_NONE] = 0.0f;
+    p.alpha[TISSUE_FAT] = p.alpha[TISSUE_MUSCLE] = p.alpha[TISSUE_BONE] = 0.60f;
+    return p;
+}
 
+void renderOverlay(const Mat& slice8u, const Mat& labels, Mat& dst, const OverlayPalette& p) {
+    CV_Assert(slice8u.depth() == CV_8U && (slice8u.channels() == 1 || slice8u.channels() == 3));
+    CV_Assert(labels.type() == CV_8U && labels.size() == slice8u.size());
+
+    // Tabla de mezcla en la pila (3 KB): lut[etiqueta][canal][gris] = base + alpha*color,
+    // igual que addWeighted(base, 1.0, color, alpha, 0). Sin memoria dinámica.
+    uchar lut[kNumTissueLabels][3][256];
+    for (int l = 0; l < kNumTissueLabels; ++l)
+        for (int c = 0; c < 3; ++c)
+            for (int v = 0; v < 256; ++v)
+                lut[l][c][v] = saturate_cast<uchar>(v * 1.0f + p.color[l][c] * p.alpha[l]);
+
+    dst.create(slice8u.size(), CV_8UC3);  // reutiliza el buffer si ya tiene ese tamaño
+    const bool gray = slice8u.channels() == 1;
+
+    for (int y = 0; y < dst.rows; ++y) {
+        const uchar* s = slice8u.ptr<uchar>(y);
+        const uchar* l = labels.ptr<uchar>(y);
+        uchar* d = dst.ptr<uchar>(y);
+        for (int x = 0; x < dst.cols; ++x, d += 3) {
+            const int lab = std::min<int>(l[x], kNumTissueLabels - 1);
+            if (gray) {
+                const uchar v = s[x];
+                d[0] = lut[lab][0][v]; d[1] = lut[lab][1][v]; d[2] = lut[lab][2][v];
+            } else {
+                const uchar* sp = s + 3 * x;
+                d[0] = lut[lab][0][sp[0]]; d[1] = lut[lab][1][sp[1]]; d[2] = lut[lab][2][sp[2]];
+            }
+        }
+    }
+}
+
+Mat colorizeAndOverlay(const Mat& slice8u, const AnatomyMasks& m) {
+    Mat labels = m.labels;
+    if (labels.empty()) {
+        // Máscaras sueltas (sin mapa): reconstruir etiquetas con la misma jerarquía
+        labels = Mat::zeros(slice8u.size(), CV_8U);
+        labels.setTo(Scalar(TISSUE_FAT), m.fat);
+        labels.setTo(Scalar(TISSUE_MUSCLE), m.muscle_tendon);
+        labels.setTo(Scalar(TISSUE_BONE), m.bones);
+    }
+    Mat final_overlay;
+    renderOverlay(slice8u, labels, final_overlay);
     return final_overlay;
-}
\ No newline at end of file
+}
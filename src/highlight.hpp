@@ -3,16 +3,58 @@
 
 #include <opencv2/core/core.hpp> 
 
+// Etiquetas del mapa de tejidos (CV_8U). Jerarquía: hueso > músculo > grasa.
+enum TissueLabel : unsigned char {
+    TISSUE_NONE   = 0,
+    TISSUE_FAT    = 1,
+    TISSUE_MUSCLE = 2,
+    TISSUE_BONE   = 3
+};
+constexpr int kNumTissueLabels = 4;
+
+// Umbrales HU de cada tejido (rangos cerrados)
+struct TissueThresholds {
+    float fatMin    = -190.f, fatMax    = -30.f;
+    float muscleMin = 10.f,   muscleMax = 120.f;
+    float boneMin   = 200.f;
+};
+
 // Estructura para contener las 3 máscaras de tejidos
 struct AnatomyMasks {
     cv::Mat fat;
     cv::Mat muscle_tendon;
     cv::Mat bones;
+    cv::Mat labels;   // mapa de etiquetas (TissueLabel) del que se derivan las máscaras
 };
 
 // Declaraciones de funciones (Firmas)
 cv::Mat huTo8u(const cv::Mat& hu32f, float window_center, float window_width);
-AnatomyMasks generateAnatomicalMasksHU(const cv::Mat& hu32f);
+
+// Una lectura del HU → las tres máscaras crudas (0/255) por umbral. Los
+// destinos se reutilizan si ya tienen tamaño y tipo (create).
+void thresholdTissuesHU(const cv::Mat& hu32f, const TissueThresholds& t,
+                        cv::Mat& fat, cv::Mat& muscle, cv::Mat& bones);
+// Máscaras → mapa de etiquetas con la jerarquía hueso > músculo > grasa
+void resolveTissueHierarchy(const cv::Mat& fat, const cv::Mat& muscle, const cv::Mat& bones,
+                            cv::Mat& labels);
+
+// Clasificación fusionada: una lectura del HU → mapa de etiquetas CV_8U
+cv::Mat generateTissueLabelsHU(const cv::Mat& hu32f, const TissueThresholds& t = TissueThresholds());
+// Máscaras 0/255 por tejido a partir de las etiquetas, en buffers del pool del hilo.
+AnatomyMasks masksFromLabels(const cv::Mat& labels);
+AnatomyMasks generateAnatomicalMasksHU(const cv::Mat& hu32f, const TissueThresholds& t = TissueThresholds());
+
+// Color BGR y transparencia por etiqueta
+struct OverlayPalette {
+    cv::Vec3b color[kNumTissueLabels];
+    float alpha[kNumTissueLabels];
+};
+OverlayPalette defaultOverlayPalette();
+
+// Mezcla todas las clases en una pasada a partir del mapa de etiquetas y escribe
+// en dst (BGR, se reutiliza si ya tiene el tamaño correcto: sin reservas por llamada).
+void renderOverlay(const cv::Mat& slice8u, const cv::Mat& labels, cv::Mat& dst,
+                   const OverlayPalette& p = defaultOverlayPalette());
 cv::Mat colorizeAndOverlay(const cv::Mat& slice8u, const AnatomyMasks& m);
 
 #endif // HIGHLIGHT_HPP
\ No newline at end of file
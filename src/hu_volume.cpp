@@ -0,0 +1,197 @@
+#include "hu_volume.hpp"
+#include "slice_provider.hpp"
+#include "itk_opencv_bridge.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <itkGDCMImageIO.h>
+
+using namespace cv;
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kMagic[8] = {'H', 'U', 'V', 'O', 'L', 0, 0, 0};
+
+void copyString(char* dst, size_t cap, const std::string& s) {
+  std::memset(dst, 0, cap);
+  std::memcpy(dst, s.data(), std::min(cap - 1, s.size()));
+}
+
+std::string tagValue(itk::GDCMImageIO* io, const char* tag) {
+  std::string v;
+  io->GetValueFromTag(tag, v);
+  // Los valores DICOM vienen rellenos con espacios o NUL
+  while (!v.empty() && (v.back() == ' ' || v.back() == '\0')) v.pop_back();
+  return v;
+}
+
+} // namespace
+
+void directoryFingerprint(const std::string& dicomDir, std::uint64_t& count, std::int64_t& mtime) {
+  count = 0;
+  mtime = 0;
+  for (const auto& e : fs::directory_iterator(dicomDir)) {
+    if (!e.is_regular_file()) continue;
+    ++count;
+    mtime = std::max<std::int64_t>(mtime, e.last_write_time().time_since_epoch().count());
+  }
+}
+
+void convertSeriesToHUVolume(const std::string& dicomDir, const std::string& path) {
+  LazySliceProvider provider(dicomDir);
+  const unsigned depth = (unsigned)provider.numSlices();
+
+  HUVolumeHeader h{};
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.byteOrder = kHUVolumeByteOrder;
+  h.version = kHUVolumeVersion;
+  h.headerSize = sizeof(HUVolumeHeader);
+  h.depth = depth;
+  h.sliceOrder = 1;
+  for (int i = 0; i < 3; ++i) h.spacing[i] = provider.spacing()[i];
+  // GDCMImageIO ya entrega HU: el volumen se guarda reescalado
+  h.slope = 1.0;
+  h.intercept = 0.0;
+  directoryFingerprint(dicomDir, h.sourceCount, h.sourceMTime);
+  copyString(h.seriesUID, sizeof(h.seriesUID), provider.seriesUID());
+  copyString(h.sourceDir, sizeof(h.sourceDir), fs::weakly_canonical(dicomDir).string());
+
+  {
+    auto io = itk::GDCMImageIO::New();
+    io->SetFileName(provider.files().front());
+    io->ReadImageInformation();
+    h.width = (std::uint32_t)io->GetDimensions(0);
+    h.height = (std::uint32_t)io->GetDimensions(1);
+    for (unsigned i = 0; i < 3; ++i) h.origin[i] = io->GetOrigin(i);
+    copyString(h.studyUID, sizeof(h.studyUID), tagValue(io, "0020|000d"));
+  }
+
+  std::string fileList;
+  for (const auto& f : provider.files()) fileList += fs::path(f).filename().string() + "\n";
+  h.filesOffset = sizeof(HUVolumeHeader);
+  h.filesBytes = fileList.size();
+  h.dataOffset = (h.filesOffset + h.filesBytes + kHUVolumeAlignment - 1) / kHUVolumeAlignment * kHUVolumeAlignment;
+
+  fs::create_directories(fs::absolute(path).parent_path());
+  const std::string tmp = path + ".tmp";
+  std::ofstream out(tmp, std::ios::binary);
+  if (!out) throw std::runtime_error("No se pudo crear " + tmp);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.write(fileList.data(), fileList.size());
+  const std::vector<char> pad(h.dataOffset - h.filesOffset - h.filesBytes, 0);
+  out.write(pad.data(), pad.size());
+
+  // Decodificación en paralelo por bloques y escritura en orden: en memoria
+  // solo hay un bloque de slices, no el volumen.
+  const unsigned block = (unsigned)std::max(1, getNumThreads());
+  std::vector<ImageType2D::Pointer> slices(block);
+  for (unsigned z0 = 0; z0 < depth; z0 += block) {
+    const unsigned n = std::min(block, depth - z0);
+    std::string error;
+    std::atomic<bool> failed{false};
+    parallel_for_(Range(0, (int)n), [&](const Range& r) {
+      for (int i = r.start; i < r.end; ++i) {
+        try {
+          slices[i] = provider.readSlice(z0 + i);
+        } catch (const std::exception& e) {
+          if (!failed.exchange(true)) error = e.what();
+        }
+      }
+    });
+    if (failed) {
+      out.close();
+      fs::remove(tmp);
+      throw std::runtime_error("Slice " + std::to_string(z0) + "+: " + error);
+    }
+
+    for (unsigned i = 0; i < n; ++i) {
+      const Mat view = itkSliceView16s(slices[i]);
+      if (view.cols != (int)h.width || view.rows != (int)h.height) {
+        out.close();
+        fs::remove(tmp);
+        throw std::runtime_error("Slice " + std::to_string(z0 + i) + " con dimensiones distintas");
+      }
+      out.write(view.ptr<char>(), view.total() * view.elemSize());
+      slices[i] = nullptr;
+    }
+  }
+
+  out.close();
+  if (!out) {
+    fs::remove(tmp);
+    throw std::runtime_error("Error escribiendo " + tmp);
+  }
+  fs::rename(tmp, path);
+}
+
+MappedHUVolume::MappedHUVolume(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("No se pudo abrir " + path);
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(HUVolumeHeader)) {
+    ::close(fd);
+    throw std::runtime_error("Archivo HUV truncado: " + path);
+  }
+  mapBytes_ = (size_t)st.st_size;
+  map_ = ::mmap(nullptr, mapBytes_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);  // la proyección sigue viva sin el descriptor
+  if (map_ == MAP_FAILED) {
+    map_ = nullptr;
+    throw std::runtime_error("mmap falló: " + path);
+  }
+
+  header_ = static_cast<const HUVolumeHeader*>(map_);
+  const HUVolumeHeader& h = *header_;
+  const std::uint64_t dataBytes = (std::uint64_t)h.width * h.height * h.depth * sizeof(std::int16_t);
+  std::string problem;
+  if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0) problem = "no es un archivo HUV";
+  else if (h.byteOrder != kHUVolumeByteOrder)
+    problem = "orden de bytes distinto o formato anterior a la versión 2";
+  else if (h.version != kHUVolumeVersion || h.headerSize != sizeof(HUVolumeHeader))
+    problem = "versión de formato no soportada";
+  else if (h.dataOffset % kHUVolumeAlignment != 0 || h.filesOffset + h.filesBytes > h.dataOffset ||
+           h.dataOffset + dataBytes > mapBytes_)
+    problem = "archivo truncado o cabecera inconsistente";
+  if (!problem.empty()) {
+    ::munmap(map_, mapBytes_);
+    map_ = nullptr;
+    throw std::runtime_error("HUV inválido (" + problem + "): " + path);
+  }
+
+  std::istringstream names(std::string(static_cast<const char*>(map_) + h.filesOffset, h.filesBytes));
+  for (std::string line; std::getline(names, line);) files_.push_back(line);
+  for (size_t i = 0; i < files_.size(); ++i) zByName_.emplace(files_[i], (int)i);
+}
+
+MappedHUVolume::~MappedHUVolume() {
+  if (map_) ::munmap(map_, mapBytes_);
+}
+
+Mat MappedHUVolume::sliceView16s(unsigned z) const {
+  if (z >= header_->depth) throw std::runtime_error("Índice Z fuera de rango");
+  const size_t sliceBytes = (size_t)header_->width * header_->height * sizeof(std::int16_t);
+  const char* p = static_cast<const char*>(map_) + header_->dataOffset + z * sliceBytes;
+  return Mat(height(), width(), CV_16S, const_cast<char*>(p));
+}
+
+void MappedHUVolume::sliceHU32f(unsigned z, Mat& dst) const {
+  convert16sToHU32f(sliceView16s(z), dst, RescaleParams{header_->slope, header_->intercept});
+}
+
+int MappedHUVolume::indexOf(const std::string& filePath) const {
+  // Solo archivos del directorio de origen: otra serie puede repetir los nombres
+  const fs::path target = fs::weakly_canonical(fs::path(filePath));
+  if (target.parent_path().string() != header_->sourceDir) return -1;
+  auto it = zByName_.find(target.filename().string());
+  return it != zByName_.end() ? it->second : -1;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Formato .huv: volumen HU int16 contiguo, pensado para abrirse con mmap.
+//
+//   [HUVolumeHeader][lista de archivos fuente, un nombre por línea][relleno]
+//   [pixel data: depth × height × width int16, x más rápido, z en orden GDCM]
+//
+// El pixel data empieza en un múltiplo de 4096 (alineado a página), así que
+// cada slice es una vista cv::Mat sin copia sobre la proyección en memoria.
+// Todo en el orden de bytes de la máquina que convierte; byteOrder lo marca y
+// MappedHUVolume rechaza el archivo si no coincide con el de la que lo abre.
+struct HUVolumeHeader {
+  char magic[8];            // "HUVOL\0\0\0"
+  std::uint32_t byteOrder;  // kHUVolumeByteOrder escrito en el orden nativo
+  std::uint32_t version;    // kHUVolumeVersion
+  std::uint32_t headerSize; // sizeof(HUVolumeHeader)
+  std::uint64_t filesOffset;
+  std::uint64_t filesBytes;
+  std::uint64_t dataOffset; // múltiplo de kHUVolumeAlignment
+  std::uint32_t width, height, depth;
+  std::int32_t sliceOrder;  // +1: slices en el orden de GDCMSeriesFileNames
+  double spacing[3];        // mm [x, y, z]
+  double origin[3];         // del primer slice
+  double slope, intercept;  // HU = valor * slope + intercept (identidad tras GDCM)
+  std::uint64_t sourceCount;  // huella del directorio al convertir (ver slice_source)
+  std::int64_t sourceMTime;
+  char seriesUID[128];
+  char studyUID[128];
+  char sourceDir[1024];     // ruta canónica del directorio de la serie
+};
+
+constexpr std::uint32_t kHUVolumeByteOrder = 0x01020304;
+constexpr std::uint32_t kHUVolumeVersion = 2;
+constexpr std::uint64_t kHUVolumeAlignment = 4096;
+
+// Huella barata del directorio de la serie (sin GDCM): nº de archivos y mtime
+// máximo. Se guarda en la cabecera para detectar si la serie cambió.
+void directoryFingerprint(const std::string& dicomDir, std::uint64_t& count, std::int64_t& mtime);
+
+// Decodifica la serie DICOM de dicomDir (en paralelo, por bloques) y la
+// escribe en path (vía archivo temporal + rename, nunca queda a medias).
+// Lanza std::runtime_error si algo falla.
+void convertSeriesToHUVolume(const std::string& dicomDir, const std::string& path);
+
+// Lector por mmap (solo lectura). Abrir cuesta una llamada a mmap y la
+// validación de la cabecera; los píxeles se cargan bajo demanda por el kernel.
+class MappedHUVolume {
+public:
+  explicit MappedHUVolume(const std::string& path);
+  ~MappedHUVolume();
+
+  MappedHUVolume(const MappedHUVolume&) = delete;
+  MappedHUVolume& operator=(const MappedHUVolume&) = delete;
+
+  const HUVolumeHeader& header() const { return *header_; }
+  int width() const { return (int)header_->width; }
+  int height() const { return (int)header_->height; }
+  size_t numSlices() const { return header_->depth; }
+  // Nombres (sin directorio) de los archivos fuente, en orden Z.
+  const std::vector<std::string>& files() const { return files_; }
+
+  // Vista CV_16S sin copia sobre la proyección. Memoria de solo lectura:
+  // escribir en ella provoca un fallo de segmentación.
+  cv::Mat sliceView16s(unsigned z) const;
+  // HU en CV_32F (convert16sToHU32f con el slope/intercept de la cabecera).
+  void sliceHU32f(unsigned z, cv::Mat& dst) const;
+
+  // Índice Z del archivo fuente (del directorio sourceDir), o -1.
+  int indexOf(const std::string& filePath) const;
+
+private:
+  void* map_ = nullptr;
+  size_t mapBytes_ = 0;
+  const HUVolumeHeader* header_ = nullptr;
+  std::vector<std::string> files_;
+  std::unordered_map<std::string, int> zByName_;
+};
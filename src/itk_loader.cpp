@@ -5,8 +5,7 @@
 #include <itkGDCMSeriesFileNames.h>
 #include <itkExtractImageFilter.h>
 
-Volume loadDicomSeries(const std::string& dicomDir) {
-  auto imageIO = itk::GDCMImageIO::New();
+DicomSeriesInfo findDicomSeries(const std::string& dicomDir) {
   auto nameGen = itk::GDCMSeriesFileNames::New();
   nameGen->SetUseSeriesDetails(true);
   nameGen->SetDirectory(dicomDir);
@@ -14,14 +13,25 @@ Volume loadDicomSeries(const std::string& dicomDir) {
   const auto& seriesUIDs = nameGen->GetSeriesUIDs();
   if (seriesUIDs.empty()) throw std::runtime_error("No se encontraron series DICOM en: " + dicomDir);
 
-  const auto files = nameGen->GetFileNames(seriesUIDs.front());
+  return { seriesUIDs.front(), nameGen->GetFileNames(seriesUIDs.front()) };
+}
+
+Volume readDicomSeries(const DicomSeriesInfo& series) {
+  auto imageIO = itk::GDCMImageIO::New();
   using ReaderType = itk::ImageSeriesReader<ImageType3D>;
   auto reader = ReaderType::New();
   reader->SetImageIO(imageIO);
-  reader->SetFileNames(files);
+  reader->SetFileNames(series.files);
   reader->Update();
 
-  return { reader->GetOutput(), files };
+  // Desconectar del reader: el volumen puede sobrevivir al pipeline.
+  ImageType3D::Pointer image = reader->GetOutput();
+  image->DisconnectPipeline();
+  return { image, series.files, series.seriesUID };
+}
+
+Volume loadDicomSeries(const std::string& dicomDir) {
+  return readDicomSeries(findDicomSeries(dicomDir));
 }
 
 ImageType2D::Pointer extractSlice(const ImageType3D::Pointer& vol, unsigned int z) {
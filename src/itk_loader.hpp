@@ -11,7 +11,17 @@ using ImageType2D = itk::Image< PixelType, 2 >;
 struct Volume {
   ImageType3D::Pointer image;
   std::vector<std::string> files;
+  std::string seriesUID;
 };
 
+// Descubrimiento GDCM de la primera serie del directorio (solo cabeceras).
+struct DicomSeriesInfo {
+  std::string seriesUID;
+  std::vector<std::string> files;  // ordenados por GDCM
+};
+
+DicomSeriesInfo findDicomSeries(const std::string& dicomDir);
+Volume readDicomSeries(const DicomSeriesInfo& series);
+
 Volume loadDicomSeries(const std::string& dicomDir);
-ImageType2D::Pointer extractSlice(const ImageType3D::Pointer& vol, unsigned int indexZ);
\ No newline at end of file
+ImageType2D::Pointer extractSlice(const ImageType3D::Pointer& vol, unsigned int indexZ);
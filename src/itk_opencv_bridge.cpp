@@ -1,45 +1,98 @@
 #include "itk_opencv_bridge.hpp"
-#include <itkImageRegionConstIterator.h>
+#include "windowing.hpp"
+#include <itkMetaDataObject.h>
+#include <opencv2/core/hal/intrin.hpp>
 #include <algorithm>
+#include <cstdlib>
+#include <limits>
 
 using namespace cv;
 
-// Helper: copia ITK (short) a CV_32F en HU tal cual
-cv::Mat itk2cv32fHU(ImageType2D::Pointer slice, double* outMinHU, double* outMaxHU) {
-  auto region = slice->GetLargestPossibleRegion();
-  auto size   = region.GetSize(); // [x,y]
+RescaleParams rescaleFromMetaData(const itk::MetaDataDictionary& dict) {
+  RescaleParams r;
+  std::string value;
+  if (itk::ExposeMetaData<std::string>(dict, "0028|1053", value) && !value.empty())
+    r.slope = std::strtod(value.c_str(), nullptr);
+  if (itk::ExposeMetaData<std::string>(dict, "0028|1052", value) && !value.empty())
+    r.intercept = std::strtod(value.c_str(), nullptr);
+  if (r.slope == 0.0) r.slope = 1.0;  // valor corrupto: no anular la imagen
+  return r;
+}
 
-  Mat hu(size[1], size[0], CV_32F);
+cv::Mat itkSliceView16s(const ImageType2D::Pointer& slice) {
+  const auto size = slice->GetBufferedRegion().GetSize();  // [x,y]
+  return Mat((int)size[1], (int)size[0], CV_16S, slice->GetBufferPointer());
+}
 
-  itk::ImageRegionConstIterator<ImageType2D> it(slice, region);
-  float mn = std::numeric_limits<float>::infinity();
-  float mx = -std::numeric_limits<float>::infinity();
+cv::Mat itkVolumeSliceView16s(const ImageType3D::Pointer& vol, unsigned int z) {
+  const auto size = vol->GetBufferedRegion().GetSize();  // [x,y,z]
+  CV_Assert(z < size[2]);
+  PixelType* base = vol->GetBufferPointer() + size_t(z) * size[0] * size[1];
+  return Mat((int)size[1], (int)size[0], CV_16S, base);
+}
 
-  for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
-    const auto& idx = it.GetIndex(); // [x,y]
-    float v = static_cast<float>(it.Get()); // HU (assumiendo DICOM ya en HU)
-    hu.at<float>(idx[1], idx[0]) = v;
+// Una fila: ensanchado int16→int32→float, v*slope+intercept y min/max a la vez.
+static void convertRow16sTo32f(const short* src, float* dst, int n, float a, float b,
+                               float& mn, float& mx) {
+  int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+  const int VL16 = VTraits<v_int16>::vlanes();
+  const int VL32 = VTraits<v_float32>::vlanes();
+  v_float32 va = vx_setall_f32(a), vb = vx_setall_f32(b);
+  v_float32 vmn = vx_setall_f32(mn), vmx = vx_setall_f32(mx);
+  for (; x <= n - VL16; x += VL16) {
+    v_int32 lo, hi;
+    v_expand(vx_load(src + x), lo, hi);
+    v_float32 f0 = v_fma(v_cvt_f32(lo), va, vb);
+    v_float32 f1 = v_fma(v_cvt_f32(hi), va, vb);
+    vmn = v_min(vmn, v_min(f0, f1));
+    vmx = v_max(vmx, v_max(f0, f1));
+    v_store(dst + x, f0);
+    v_store(dst + x + VL32, f1);
+  }
+  mn = v_reduce_min(vmn);
+  mx = v_reduce_max(vmx);
+  vx_cleanup();
+#endif
+  for (; x < n; ++x) {
+    const float v = src[x] * a + b;
+    dst[x] = v;
     mn = std::min(mn, v);
     mx = std::max(mx, v);
   }
+}
+
+void convert16sToHU32f(const Mat& src, Mat& dst, RescaleParams rescale,
+                       double* outMinHU, double* outMaxHU) {
+  CV_Assert(src.type() == CV_16S && src.dims == 2);
+  dst.create(src.size(), CV_32F);
+
+  const float a = (float)rescale.slope, b = (float)rescale.intercept;
+  float mn = std::numeric_limits<float>::infinity();
+  float mx = -std::numeric_limits<float>::infinity();
+
+  // Si ambos son continuos se trata la imagen como una sola fila larga.
+  int rows = src.rows, cols = src.cols;
+  if (src.isContinuous() && dst.isContinuous()) { cols *= rows; rows = 1; }
+  for (int y = 0; y < rows; ++y)
+    convertRow16sTo32f(src.ptr<short>(y), dst.ptr<float>(y), cols, a, b, mn, mx);
 
   if (outMinHU) *outMinHU = mn;
   if (outMaxHU) *outMaxHU = mx;
+}
+
+// Copia ITK (short) a CV_32F en HU directamente desde el buffer (sin iteradores)
+cv::Mat itk2cv32fHU(ImageType2D::Pointer slice, double* outMinHU, double* outMaxHU,
+                    RescaleParams rescale) {
+  Mat hu;
+  convert16sToHU32f(itkSliceView16s(slice), hu, rescale, outMinHU, outMaxHU);
   return hu;
 }
 
-// Windowing HU -> 8U
+// Windowing HU -> 8U en una sola pasada (ver windowing.cpp)
 cv::Mat huTo8u(const cv::Mat& hu32f, float center, float width) {
-  CV_Assert(hu32f.type() == CV_32F);
-  const float low  = center - width * 0.5f;
-  const float high = center + width * 0.5f;
-
+  CV_Assert(hu32f.type() == CV_32F || hu32f.type() == CV_16S);
   Mat out;
-  // (hu - low) / (high-low) * 255
-  hu32f.convertTo(out, CV_32F, 255.0f / std::max(1e-6f, (high - low)), -low * 255.0f / std::max(1e-6f, (high - low)));
-  // saturar a [0,255] y pasar a 8U
-  cv::min(out, 255, out);
-  cv::max(out, 0, out);
-  out.convertTo(out, CV_8U);
+  applyWindow(hu32f, out, HUWindow{ center, width });
   return out;
-}
\ No newline at end of file
+}
@@ -1,12 +1,38 @@
 #pragma once
 #include "itk_loader.hpp"      // define ImageType2D
 #include <opencv2/core.hpp>
+#include <itkMetaDataDictionary.h>
+
+// Reescalado DICOM: HU = valor_almacenado * slope + intercept
+// (RescaleSlope 0028|1053, RescaleIntercept 0028|1052).
+// Nota: GDCMImageIO ya aplica el reescalado al leer, así que para imágenes
+// leídas con itk_loader se usa la identidad; los parámetros sirven para
+// fuentes que entregan los valores almacenados tal cual.
+struct RescaleParams {
+  double slope = 1.0;
+  double intercept = 0.0;
+};
+
+// Lee slope/intercept del diccionario DICOM (identidad si no están).
+RescaleParams rescaleFromMetaData(const itk::MetaDataDictionary& dict);
+
+// Vistas CV_16S sin copia sobre el buffer ITK (filas contiguas, x más rápido).
+// Comparten memoria: la imagen ITK debe sobrevivir a la vista.
+cv::Mat itkSliceView16s(const ImageType2D::Pointer& slice);
+cv::Mat itkVolumeSliceView16s(const ImageType3D::Pointer& vol, unsigned int z);
+
+// Núcleo de conversión: int16 → float32 con slope/intercept, fusionado con la
+// reducción min/max en una sola pasada (SIMD). dst se (re)asigna si hace falta.
+void convert16sToHU32f(const cv::Mat& src16s, cv::Mat& dst32f, RescaleParams rescale = {},
+                       double* outMinHU = nullptr, double* outMaxHU = nullptr);
 
 // Convierte un slice ITK (short HU con MetaData) a CV_32F en HU reales.
 // Devuelve además min/max HU si se pasan punteros.
 cv::Mat itk2cv32fHU(ImageType2D::Pointer slice,
                     double* outMinHU = nullptr,
-                    double* outMaxHU = nullptr);
+                    double* outMaxHU = nullptr,
+                    RescaleParams rescale = {});
 
-// Ventaneo HU → 8-bit para visualización (center/width estilo DICOM)
-cv::Mat huTo8u(const cv::Mat& hu32f, float center, float width);
\ No newline at end of file
+// Ventaneo HU → 8-bit para visualización (center/width estilo DICOM).
+// Acepta CV_32F (núcleo SIMD) o CV_16S (LUT de 64K); ver windowing.hpp.
+cv::Mat huTo8u(const cv::Mat& hu32f, float center, float width);
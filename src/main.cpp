@@ -2,18 +2,34 @@
 #include "itk_opencv_bridge.hpp"
 #include "highlight.hpp"
 #include "dnn_denoising.hpp" 
+#include "pipeline.hpp"
+#include "batch.hpp"
+#include "slice_provider.hpp"
+#include "slice_source.hpp"
+#include "series_cache.hpp"
+#include "hu_volume.hpp"
+#include "volume_segmentation.hpp"
+#include "nlmeans.hpp"
+#include "morphology.hpp"
+#include "thread_pool.hpp"
+#include "buffer_pool.hpp"
+#include "profiler.hpp"
+#include "output_writer.hpp"
+#include "slice_navigator.hpp"
+#include "dicom_index.hpp"
 
 #include <filesystem>
 #include <iostream>
 #include <vector>
 #include <algorithm>
 #include <cstdio>
+#include <cstdlib>
 #include <memory>
 #include <array>
 #include <opencv2/opencv.hpp>
 #include <opencv2/dnn.hpp>
 #include <opencv2/imgproc.hpp>
-#include <opencv2/photo.hpp> 
+#include <opencv2/photo.hpp>
 
 using namespace cv;
 using namespace std;
@@ -43,6 +59,32 @@ string abrirSelectorDeArchivo() {
     return path;
 }
 
+// Origen de la serie (volumen .huv por mmap si existe; si no, DICOM perezoso)
+// desde la caché global, con clave directorio + SeriesInstanceUID: volver a
+// una serie reciente no relee cabeceras y los slices ya vistos no se decodifican
+// otra vez.
+shared_ptr<SliceSource> origenDeSerie(const string& dicomDir) {
+    SeriesCache& cache = globalSeriesCache();
+    const size_t aciertos = cache.stats().seriesHits;
+    shared_ptr<SliceSource> source;
+    {
+        PROFILE_SCOPE("series_open");
+        source = cache.open(dicomDir);
+    }
+    if (cache.stats().seriesHits > aciertos) {
+        cout << "[CACHE] Serie ya abierta (" << cache.bytesInUse() / (1024.0 * 1024.0) << " MB de slices en cache).\n";
+    } else {
+        cout << "[CARGANDO] Origen: " << source->kind() << " (" << source->numSlices() << " slices)\n";
+    }
+    // Cambio de serie: los buffers libres del pool de este hilo eran del
+    // tamaño de la anterior (con otra matriz no se reutilizarían)
+    static string serieActual;
+    const string serie = fs::weakly_canonical(dicomDir).string() + '|' + source->seriesUID();
+    if (!serieActual.empty() && serie != serieActual) threadBufferPool().trim();
+    serieActual = serie;
+    return source;
+}
+
 // ======================================================================================
 // 2. PROCESAMIENTO: 12 EVIDENCIAS
 // ======================================================================================
@@ -53,169 +95,534 @@ void procesarArchivoSeleccionado(const string& filePath) {
 
     cout << "\n[CARGANDO] Archivo: " << selectedFileName << "\n";
     
-    DnnDenoiser* denoiserPtr = nullptr;
     try {
-        try {
-            denoiserPtr = new DnnDenoiser("../models/dncnn_compatible.onnx"); 
-            cout << "[INIT] DNN Cargado.\n";
-        } catch (...) { cout << "[AVISO] DNN no disponible.\n"; }
-        
-        // --- CARGA ITK ---
-        auto vol = loadDicomSeries(dicomDir);
-        if (vol.image.IsNull()) {
-            if (system("zenity --error --text=\"Error al leer DICOM.\"")) {}
-            return;
+        // El modelo se carga una sola vez por proceso
+        static bool dnnAnunciado = false;
+        DnnDenoiser* denoiserPtr = sharedDnnDenoiser("../models/dncnn_compatible.onnx");
+        if (!dnnAnunciado) {
+            cout << (denoiserPtr ? "[INIT] DNN Cargado.\n" : "[AVISO] DNN no disponible.\n");
+            dnnAnunciado = true;
         }
+        
+        // --- CARGA ---
+        const shared_ptr<SliceSource> source = origenDeSerie(dicomDir);
 
-        vector<string> filesInDir;
-        for (const auto & entry : fs::directory_iterator(dicomDir)) {
-            string ext = entry.path().extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-            if (ext == ".ima" || ext == ".dcm") filesInDir.push_back(entry.path().filename().string());
+        int targetIndex = source->indexOf(filePath);
+        if (targetIndex < 0) {
+            if (system("zenity --error --text=\"El archivo no pertenece a la serie detectada.\"")) {}
+            return;
         }
-        std::sort(filesInDir.begin(), filesInDir.end());
 
-        int targetIndex = 0;
-        for (size_t i = 0; i < filesInDir.size(); ++i) {
-            if (filesInDir[i] == selectedFileName) { targetIndex = (int)i; break; }
+        Mat hu32f_raw;
+        {
+            PROFILE_SCOPE("slice_read");
+            hu32f_raw = source->readSliceHU(targetIndex);
         }
-
-        auto slice = extractSlice(vol.image, targetIndex);
-        double huMin = 0.0, huMax = 0.0;
-        Mat hu32f_raw = itk2cv32fHU(slice, &huMin, &huMax); 
         
+        // Grupos A, B y C (ver pipeline.cpp). Las etapas independientes del
+        // grafo (NLMeans, DnCNN, segmentaciones) corren en paralelo.
+        static ThreadPool stagePool(4);
+        PipelineOptions opciones;
+        opciones.verbose = true;
+        opciones.pool = &stagePool;
+        // El original también en ventana de hueso y de pulmón, en la misma pasada
+        opciones.extraWindows = { kWindowBone, kWindowLung };
+        SliceOutputs outputs;
+        processSliceHU(hu32f_raw, denoiserPtr, outputs, opciones);
+
         // =========================================================
-        // GRUPO A: LIMPIEZA DE IMAGEN (4 IMÁGENES)
+        // GUARDADO Y VISUALIZACIÓN (12 VENTANAS)
         // =========================================================
-        
-        // 1. ORIGINAL
-        Mat img_1_original = huTo8u(hu32f_raw, 40.0f, 400.0f);
-
-        // 2. SUAVIZADA CON GAUSS (Clásica)
-        Mat img_2_gauss;
-        GaussianBlur(img_1_original, img_2_gauss, Size(5, 5), 1.0);
-
-        // 3. SUAVIZADA CON NLMEANS (Avanzada Matemática)
-        Mat img_3_nlmeans;
-        cout << "[PROCESO] Calculando NLMeans...\n";
-        fastNlMeansDenoising(img_1_original, img_3_nlmeans, 10, 7, 21);
-
-        // 4. SUAVIZADA CON DNCNN (Deep Learning)
-        Mat img_4_dncnn;
-        if (denoiserPtr) {
-            cout << "[PROCESO] Ejecutando DnCNN...\n";
-            img_4_dncnn = denoiserPtr->denoise(img_1_original);
+        // Las PNG se codifican en segundo plano mientras se muestran las
+        // ventanas: solo se espera al escritor cuando el usuario las cierra
+        static OutputWriter escritor;
+        saveSliceOutputs(outputs, "outputs/final", escritor);
+
+        for (int i = 0; i < kNumOutputs; ++i) {
+            imshow(kOutputInfo[i].windowTitle, outputs.images[i]);
+        }
+        for (const WindowedImage& v : outputs.extraWindows) imshow(extraWindowName(v.window), v.image);
+        waitKey(0);
+        destroyAllWindows();
+
+        // Las estadísticas del escritor son acumuladas: se comparan con la llamada anterior
+        static uint64_t fallosPrevios = 0;
+        const uint64_t fallos = escritor.flush().failed - fallosPrevios;
+        fallosPrevios += fallos;
+        if (fallos == 0) {
+            cout << "\n[EXITO] Se han generado las 12 EVIDENCIAS solicitadas.\n";
+            cout << "Revisa la carpeta 'outputs/final/'.\n";
         } else {
-            img_4_dncnn = img_1_original.clone();
+            cout << "\n[AVISO] " << fallos << " imagenes no se pudieron guardar.\n";
         }
 
-        // =========================================================
-        // GRUPO B: PROCESAMIENTO MORFOLÓGICO Y BORDES (5 IMÁGENES)
-        // =========================================================
-        Mat k = getStructuringElement(MORPH_RECT, Size(3, 3));
-        
-        // 5. BORDES (Canny)
-        Mat img_5_bordes;
-        Canny(img_2_gauss, img_5_bordes, 50, 150);
+    } catch (const std::exception& e) {
+        string msg = "Error: " + string(e.what());
+        cerr << msg << endl;
+        if (system(("zenity --error --text=\"" + msg + "\"").c_str())) {}
+    }
+}
 
-        // 6. TOPHAT
-        Mat img_6_tophat;
-        morphologyEx(img_1_original, img_6_tophat, MORPH_TOPHAT, k);
+// ======================================================================================
+// 3. NAVEGADOR DE LA SERIE (flechas + ventana, con prefetch)
+// ======================================================================================
+void navegarSerie(const string& filePath) {
+    fs::path p(filePath);
+    try {
+        const shared_ptr<SliceSource> source = origenDeSerie(p.parent_path().string());
+        const int z = source->indexOf(filePath);
+        if (z < 0) {
+            if (system("zenity --error --text=\"El archivo no pertenece a la serie detectada.\"")) {}
+            return;
+        }
+        SliceNavigator navegador(*source);
+        navegador.run(z);
+    } catch (const std::exception& e) {
+        string msg = "Error: " + string(e.what());
+        cerr << msg << endl;
+        if (system(("zenity --error --text=\"" + msg + "\"").c_str())) {}
+    }
+}
 
-        // 7. BLACKHAT
-        Mat img_7_blackhat;
-        morphologyEx(img_1_original, img_7_blackhat, MORPH_BLACKHAT, k);
+// ======================================================================================
+// MAIN
+// ======================================================================================
+// Compara los NLMeans rápidos con cv::fastNlMeansDenoising(10, 7, 21) sobre un
+// slice real: tiempos y PSNR frente al umbral kNLMeansMinPSNR sobre la ventana
+// (batch con --nlm fast o fast3d, este con los slices vecinos de la serie) y
+// sobre el HU (navegador).
+static int comprobarNLMeans(const string& archivo) {
+    auto source = openSliceSource(fs::path(archivo).parent_path().string());
+    const int z = source->indexOf(archivo);
+    if (z < 0) { cerr << "El archivo no pertenece a la serie detectada.\n"; return 1; }
 
-        // 8. EROSIÓN
-        Mat img_8_erosion;
-        erode(img_1_original, img_8_erosion, k);
+    bool todosPasan = true;
+    for (NLMeansEngine motor : { NLMeansEngine::Fast, NLMeansEngine::Fast3D, NLMeansEngine::FastHU }) {
+        const NLMeansComparison c = compareNLMeansEngine(*source, (unsigned)z, motor);
+        cout << "[NLM] " << nlmEngineName(motor) << ": OpenCV " << c.openCVMs << " ms | Rapido: " << c.fastMs
+             << " ms | PSNR: " << c.psnr << " dB (minimo " << kNLMeansMinPSNR << " dB)\n";
+        todosPasan = todosPasan && c.psnr >= kNLMeansMinPSNR;
+    }
+    return todosPasan ? 0 : 1;
+}
 
-        // 9. DILATACIÓN
-        Mat img_9_dilatacion;
-        dilate(img_1_original, img_9_dilatacion, k);
+// Motor de morfología (morphAll, con van Herk/Gil-Werman en los segmentos
+// largos) frente a cv::erode/dilate/morphologyEx con varios elementos
+// estructurantes, y salidas 6-9 del pipeline frente a OpenCV. Todo debe
+// coincidir píxel a píxel. Sin archivo se usa ruido uniforme.
+static int comprobarMorfologia(const string& archivo) {
+    Mat hu;
+    if (archivo.empty()) {
+        Mat ruido(512, 512, CV_8U);
+        RNG(12345).fill(ruido, RNG::UNIFORM, 0, 256);
+        ruido.convertTo(hu, CV_32F, kWindowSoftTissue.width / 255.0,
+                        kWindowSoftTissue.center - kWindowSoftTissue.width / 2);
+    } else {
+        fs::path p(archivo);
+        LazySliceProvider provider(p.parent_path().string());
+        const int z = provider.indexOf(archivo);
+        if (z < 0) { cerr << "El archivo no pertenece a la serie detectada.\n"; return 1; }
+        hu = itk2cv32fHU(provider.readSlice(z));
+    }
+    Mat img;
+    applyWindow(hu, img, kWindowSoftTissue);
 
+    auto iguales = [](const Mat& a, const Mat& b) {
+        return a.size() == b.size() && a.type() == b.type() && cv::norm(a, b, NORM_INF) == 0;
+    };
+    int fallos = 0;
 
-        // =========================================================
-        // GRUPO C: SEGMENTACIÓN FINAL (3 IMÁGENES)
-        // =========================================================
-        
-        // 10. SEGMENTACIÓN EN ORIGINAL
-        AnatomyMasks masks_raw = generateAnatomicalMasksHU(hu32f_raw);
-        Mat img_10_seg_original = colorizeAndOverlay(img_1_original, masks_raw);
+    const struct { const char* nombre; int forma; Size tam; } casos[] = {
+        {"rect 3x3", MORPH_RECT, Size(3, 3)},       // pipeline (comparación directa)
+        {"rect 15x15", MORPH_RECT, Size(15, 15)},   // vHGW horizontal y vertical
+        {"rect 9x3", MORPH_RECT, Size(9, 3)},
+        {"cruz 5x5", MORPH_CROSS, Size(5, 5)},
+        {"elipse 13x13", MORPH_ELLIPSE, Size(13, 13)},
+    };
+    for (const auto& c : casos) {
+        const Mat k = getStructuringElement(c.forma, c.tam);
+        MorphSet rapido;
+        morphAll(img, k, rapido);
+        Mat e, d, th, bh;
+        erode(img, e, k);
+        dilate(img, d, k);
+        morphologyEx(img, th, MORPH_TOPHAT, k);
+        morphologyEx(img, bh, MORPH_BLACKHAT, k);
+        const bool ok = iguales(rapido.erode, e) && iguales(rapido.dilate, d) &&
+                        iguales(rapido.tophat, th) && iguales(rapido.blackhat, bh);
+        cout << "[MORF] morphAll " << c.nombre << ": " << (ok ? "igual a OpenCV" : "DIFIERE") << "\n";
+        fallos += !ok;
+    }
 
-        // 11. SEGMENTACIÓN EN SUAVIZADA CON GAUSS
-        Mat hu_gauss; 
-        GaussianBlur(hu32f_raw, hu_gauss, Size(3, 3), 1.0);
-        AnatomyMasks masks_gauss = generateAnatomicalMasksHU(hu_gauss);
-        Mat img_11_seg_gauss = colorizeAndOverlay(img_2_gauss, masks_gauss);
+    // Salidas 6-9 del pipeline, dos veces sobre el mismo SliceOutputs (la
+    // segunda reutiliza sus buffers): primero otra imagen, luego la buena
+    PipelineOptions opciones;
+    opciones.outputs = 1u | (1u << 5) | (1u << 6) | (1u << 7) | (1u << 8);
+    SliceOutputs salidas;
+    DnnDenoiser* sinDnn = nullptr;
+    processSliceHU(Mat(hu.size(), CV_32F, Scalar(kWindowSoftTissue.center)), sinDnn, salidas, opciones);
+    processSliceHU(hu, sinDnn, salidas, opciones);
 
-        // 12. SEGMENTACIÓN EN SUAVIZADA CON DNCNN
-        Mat hu_dnn_proxy;
-        GaussianBlur(hu32f_raw, hu_dnn_proxy, Size(3, 3), 0.8);
-        AnatomyMasks masks_dnn = generateAnatomicalMasksHU(hu_dnn_proxy);
-        Mat img_12_seg_dncnn = colorizeAndOverlay(img_4_dncnn, masks_dnn);
+    const Mat k = getStructuringElement(MORPH_RECT, Size(3, 3));
+    const Mat& original = salidas.images[0];
+    Mat esperadas[4];
+    morphologyEx(original, esperadas[0], MORPH_TOPHAT, k);
+    morphologyEx(original, esperadas[1], MORPH_BLACKHAT, k);
+    erode(original, esperadas[2], k);
+    dilate(original, esperadas[3], k);
+    for (int i = 0; i < 4; ++i) {
+        const bool ok = iguales(salidas.images[5 + i], esperadas[i]);
+        cout << "[MORF] Salida " << kOutputInfo[5 + i].fileName << ": " << (ok ? "igual a OpenCV" : "DIFIERE") << "\n";
+        fallos += !ok;
+    }
+    return fallos == 0 ? 0 : 1;
+}
 
+// DnCNN por teselas frente a la imagen completa sobre el slice central de la
+// serie: |diff| máxima en la escala [0,1] de la red (umbral kTileMaxAbsDiff).
+static int comprobarDnnTeselas(const string& modelo, const string& dicomDir, int tesela) {
+    auto source = openSliceSource(dicomDir);
+    const Mat hu = source->readSliceHU((unsigned)source->numSlices() / 2);
 
-        // =========================================================
-        // GUARDADO Y VISUALIZACIÓN (12 VENTANAS)
-        // =========================================================
-        fs::create_directories("outputs/final");
-        
-        // Guardar
-        imwrite("outputs/final/1_Original.png", img_1_original);
-        imwrite("outputs/final/2_Suavizada_Gaus.png", img_2_gauss);
-        imwrite("outputs/final/3_Suavizada_NLMeans.png", img_3_nlmeans);
-        imwrite("outputs/final/4_Suavizada_DnCNN.png", img_4_dncnn);
-        
-        imwrite("outputs/final/5_Bordes_Canny.png", img_5_bordes);
-        imwrite("outputs/final/6_TopHat.png", img_6_tophat);
-        imwrite("outputs/final/7_BlackHat.png", img_7_blackhat);
-        imwrite("outputs/final/8_Erosion.png", img_8_erosion);
-        imwrite("outputs/final/9_Dilatacion.png", img_9_dilatacion);
-        
-        imwrite("outputs/final/10_Seg_Original.png", img_10_seg_original);
-        imwrite("outputs/final/11_Seg_Gaus.png", img_11_seg_gauss);
-        imwrite("outputs/final/12_Seg_DnCNN.png", img_12_seg_dncnn);
-
-        // Mostrar
-        imshow("1. Original", img_1_original);
-        imshow("2. Suavizada Gaus", img_2_gauss);
-        imshow("3. Suavizada NLMeans", img_3_nlmeans);
-        imshow("4. Suavizada DnCNN", img_4_dncnn);
-        
-        imshow("5. Bordes", img_5_bordes);
-        imshow("6. TopHat", img_6_tophat);
-        imshow("7. BlackHat", img_7_blackhat);
-        imshow("8. Erosion", img_8_erosion);
-        imshow("9. Dilatacion", img_9_dilatacion);
-        
-        imshow("10. Seg. Original", img_10_seg_original);
-        imshow("11. Seg. Gaus", img_11_seg_gauss);
-        imshow("12. Seg. DnCNN", img_12_seg_dncnn);
+    DnnDenoiser completa(modelo), teselas(modelo);
+    TileOptions opciones;
+    opciones.tileSize = tesela;
+    teselas.setTiling(opciones);
 
-        cout << "\n[EXITO] Se han generado las 12 EVIDENCIAS solicitadas.\n";
-        cout << "Revisa la carpeta 'outputs/final/'.\n";
-        
-        waitKey(0);
-        destroyAllWindows();
+    const HUNormalization escala;
+    const Mat a = completa.denoiseHU(hu, escala), b = teselas.denoiseHU(hu, escala);
+    const double maxDiff = cv::norm(a, b, NORM_INF) / escala.width;
+    cout << "[DNN] Teselas de " << tesela << " px (halo " << opciones.overlap << ") frente a imagen completa: |diff| max "
+         << maxDiff << " (maximo " << kTileMaxAbsDiff << ")\n";
+    return maxDiff < kTileMaxAbsDiff ? 0 : 1;
+}
 
-    } catch (const std::exception& e) {
-        string msg = "Error: " + string(e.what());
-        cerr << msg << endl;
-        if (system(("zenity --error --text=\"" + msg + "\"").c_str())) {}
+// Cuantiza DnCNN a INT8 con slices de la serie y lo compara con FP32 (PSNR,
+// SSIM, tiempo de forward). Código de salida 0 si INT8 supera las guardas.
+static int comprobarDnnInt8(const string& modelo, const string& dicomDir, unsigned numSlices) {
+    auto source = openSliceSource(dicomDir);
+    vector<Mat> calibracion, validacion;
+    splitCalibration(sampleSlicesHU(*source, numSlices), calibracion, validacion);
+
+    DnnDenoiser denoiser(modelo);
+    const QuantizationReport r = denoiser.quantizeInt8(calibracion, validacion);
+    printQuantizationReport(r);
+    return r.accepted ? 0 : 1;
+}
+
+// Relee el volumen convertido por mmap y compara con GDCM el orden de los
+// archivos y los píxeles del primer, el central y el último slice
+static int comprobarVolumenHUV(const string& dicomDir, const string& archivo) {
+    MappedHUVolume volumen(archivo);
+    LazySliceProvider provider(dicomDir);
+    int fallos = 0;
+    if (volumen.numSlices() != provider.numSlices()) {
+        cout << "[CONVERSION] Nº de slices distinto: " << volumen.numSlices() << " vs " << provider.numSlices() << "\n";
+        return 1;
+    }
+    size_t desordenados = 0;
+    for (size_t z = 0; z < provider.numSlices(); ++z)  // mismo orden Z que GDCM
+        desordenados += volumen.files()[z] != fs::path(provider.files()[z]).filename().string();
+    cout << "[CONVERSION] Orden Z: " << (desordenados ? "DIFIERE" : "igual a GDCM") << "\n";
+    fallos += desordenados != 0;
+    const size_t n = provider.numSlices();
+    for (size_t z : {size_t(0), n / 2, n - 1}) {
+        const ImageType2D::Pointer slice = provider.readSlice((unsigned)z);  // dueño de la vista
+        const Mat original = itkSliceView16s(slice);
+        const Mat mapeado = volumen.sliceView16s((unsigned)z);
+        const bool ok = original.size() == mapeado.size() && cv::norm(original, mapeado, NORM_INF) == 0;
+        cout << "[CONVERSION] Slice " << z << ": " << (ok ? "igual a DICOM" : "DIFIERE") << "\n";
+        fallos += !ok;
+    }
+    cout << "[CONVERSION] Verificación " << (fallos ? "FALLIDA" : "OK") << "\n";
+    return fallos ? 1 : 0;
+}
+
+// Indexa (o pone al día) todo el árbol bajo raiz en el índice DICOM
+// persistente: solo se leen las cabeceras de archivos nuevos o modificados.
+// Si el árbol contiene la serie de calibración, su orden se contrasta con GDCM.
+static int indexarArbol(const string& raiz) {
+    DicomIndex indice(defaultDicomIndexPath());
+    indice.load();
+    const size_t antes = indice.numFiles();
+
+    TickMeter t;
+    t.start();
+    const size_t leidas = indice.update(raiz);
+    t.stop();
+    if (indice.dirty() && !indice.save()) {
+        cerr << "[AVISO] No se pudo guardar el indice " << indice.path() << "\n";
+        return 1;
+    }
+    cout << "[INDICE] " << indice.numFiles() << " archivos (" << antes << " antes), " << indice.numSeries()
+         << " series | cabeceras leidas: " << leidas << " | " << t.getTimeSec() << " s\n"
+         << "[INDICE] Guardado en " << indice.path() << "\n";
+
+    // Serie de referencia (L096) dentro del árbol: la agrupación y el orden Z
+    // del índice deben coincidir con los de findDicomSeries
+    const string referencia = BatchOptions().calibrationDir;
+    if (!fs::is_directory(referencia)) return 0;
+    const string canonica = fs::weakly_canonical(referencia).string();
+    const string raizCanonica = fs::weakly_canonical(raiz).string();
+    const bool dentro = canonica.compare(0, raizCanonica.size(), raizCanonica) == 0 &&
+                        (canonica.size() == raizCanonica.size() ||
+                         canonica[raizCanonica.size()] == fs::path::preferred_separator);
+    if (!dentro) return 0;
+
+    const auto series = indice.seriesInDirectory(referencia);
+    const DicomSeriesInfo serieGdcm = findDicomSeries(referencia);
+    cout << "[INDICE] Orden Z de " << referencia << ": ";
+    if (series.size() != 1) {
+        cout << "DIFIERE (" << series.size() << " series en el indice)\n";
+        return 1;
+    }
+    const vector<string>& indexados = series.front()->files;
+    size_t distintos = 0;
+    for (size_t z = 0; z < min(indexados.size(), serieGdcm.files.size()); ++z)
+        distintos += indexados[z] != fs::weakly_canonical(serieGdcm.files[z]).string();
+    if (indexados.size() == serieGdcm.files.size() && distintos == 0) {
+        cout << "igual a GDCM (" << serieGdcm.files.size() << " slices)\n";
+        return 0;
+    }
+    cout << "DIFIERE (" << indexados.size() << " frente a " << serieGdcm.files.size() << " archivos, "
+         << distintos << " posiciones distintas)\n";
+    return 1;
+}
+
+// Segmentación volumétrica de toda la serie: volúmenes por tejido en mL.
+static int segmentarVolumen(const string& dicomDir, size_t presupuestoMB) {
+    auto source = openSliceSource(dicomDir);
+    cout << "[SEG3D] Origen: " << source->kind() << " (" << source->numSlices() << " slices)\n";
+
+    VolumeSegmentationOptions opciones;
+    opciones.memoryBudget = presupuestoMB << 20;
+    opciones.verbose = true;
+
+    TickMeter t;
+    t.start();
+    const VolumeSegmentation seg = segmentVolume(*source, opciones);
+    t.stop();
+
+    static const char* nombres[kNumTissueLabels] = {"", "Grasa", "Musculo", "Hueso"};
+    cout << "\n[SEG3D] " << seg.slabs << " slabs de " << seg.slabCoreSlices << " slices, "
+         << t.getTimeSec() << " s\n";
+    for (int l = TISSUE_FAT; l <= TISSUE_BONE; ++l) {
+        const TissueVolume& tv = seg.tissues[l];
+        cout << "[SEG3D] " << nombres[l] << ": " << tv.volumeMl << " mL (" << tv.components
+             << " componentes, mayor " << tv.largestComponentMl << " mL, sin fragmentos < "
+             << opciones.minComponentMl << " mL: " << tv.volumeMlFiltered << " mL)\n";
+    }
+    return 0;
+}
+
+// La segmentación 3D no debe depender del troceado en slabs: un único slab
+// (todo el volumen) frente a slabs de un slice de núcleo, que fuerzan la
+// unión entre slabs de las componentes y el halo de la morfología en cada Z
+static int comprobarSegmentacion3D(const string& dicomDir) {
+    auto source = openSliceSource(dicomDir);
+    vector<Mat> etiquetas(source->numSlices());
+    VolumeSegmentationOptions entero;
+    // Holgado: de sobra para el volumen entero más el halo en un solo slab
+    entero.memoryBudget = (source->numSlices() + 16) * (size_t)source->sliceSize().area() * 64;
+    entero.onSlice = [&](unsigned z, const Mat& l) { etiquetas[z] = l.clone(); };
+    const VolumeSegmentation a = segmentVolume(*source, entero);
+
+    size_t distintos = 0;
+    VolumeSegmentationOptions troceado;
+    troceado.memoryBudget = 1;  // núcleo mínimo
+    troceado.onSlice = [&](unsigned z, const Mat& l) { distintos += cv::norm(etiquetas[z], l, NORM_INF) != 0; };
+    const VolumeSegmentation b = segmentVolume(*source, troceado);
+
+    int fallos = distintos != 0;
+    cout << "[SEG3D] " << a.slabs << " slab frente a " << b.slabs << ": etiquetas "
+         << (distintos ? "DIFIEREN en " + to_string(distintos) + " slices" : string("iguales")) << "\n";
+    static const char* nombres[kNumTissueLabels] = {"", "Grasa", "Musculo", "Hueso"};
+    for (int l = TISSUE_FAT; l <= TISSUE_BONE; ++l) {
+        const bool ok = a.tissues[l].voxels == b.tissues[l].voxels &&
+                        a.tissues[l].components == b.tissues[l].components;
+        cout << "[SEG3D] " << nombres[l] << ": " << a.tissues[l].components << " componentes, "
+             << (ok ? "igual" : "DIFIERE (" + to_string(b.tissues[l].components) + ")") << "\n";
+        fallos += !ok;
+    }
+    return fallos ? 1 : 0;
+}
+
+static void imprimirUso(const char* prog) {
+    cout << "Uso:\n"
+         << "  " << prog << "                      Modo interactivo (menu + selector o navegador)\n"
+         << "  " << prog << " --batch <dir_serie> [--out <dir>] [--threads N] [--model <onnx>]\n"
+         << "          [--dnn-batch N] [--dnn-tile N] [--outputs 1,4,12]\n"
+         << "          [--format png|tiff|raw] [--compression 0-9] [--writers N]\n"
+         << "          [--decode-threads N] [--queue N] [--dnn-threads N]\n"
+         << "          [--precision fp32|int8] [--calib <dir_serie>] [--calib-slices N]\n"
+         << "          [--nlm opencv|fast|fast3d|fasthu]   (los rapidos solo si superan el PSNR minimo en el slice central)\n"
+         << "          [--windows bone,lung,C/W]   (salida 1 tambien en esas ventanas)\n"
+         << "  " << prog << " --nlm-check <archivo.IMA>\n"
+         << "  " << prog << " --morph-check [archivo.IMA]   Morfologia rapida frente a OpenCV (sin archivo: ruido)\n"
+         << "  " << prog << " --dnn-check [dir_serie [hilos]]   Teselas frente a imagen completa e INT8 frente a FP32\n"
+         << "  " << prog << " --convert <dir_serie> [archivo.huv]   Volumen HU por mmap\n"
+         << "          (sin archivo: outputs/cache/, que batch e interactivo usan solos)\n"
+         << "  " << prog << " --index <dir_raiz>   Indice de cabeceras DICOM (incremental)\n"
+         << "          (si el arbol contiene la serie de calibracion, compara su orden con GDCM)\n"
+         << "  " << prog << " --segment3d <dir_serie> [presupuesto_MB]   Volumenes por tejido (mL)\n"
+         << "  " << prog << " --seg3d-check [dir_serie]   Segmentacion 3D en un slab frente a muchos\n"
+         << "Hilos de OpenCV por forward DnCNN y NLMeans: --dnn-threads N en batch (por defecto\n"
+         << "          nucleos / --threads) y en el\n"
+         << "          modo interactivo (por defecto los de OpenCV); hilos en --dnn-check\n"
+         << "Perfilado (con cualquier modo): [--profile <base>] -> <base>.json y <base>.csv,\n"
+         << "          [--trace <traza.json>] -> traza para chrome://tracing\n";
+}
+
+// Escribe los informes pedidos con --profile / --trace.
+static void escribirPerfil(const string& base, const string& traza) {
+    Profiler& prof = Profiler::instance();
+    if (!prof.enabled()) return;
+    prof.printSummary(cout);
+    if (!base.empty()) {
+        if (prof.writeJson(base + ".json") && prof.writeCsv(base + ".csv"))
+            cout << "[PERFIL] Informe en " << base << ".json / .csv\n";
+        else
+            cerr << "[AVISO] No se pudo escribir el informe " << base << "\n";
+    }
+    if (!traza.empty()) {
+        if (prof.writeChromeTrace(traza)) cout << "[PERFIL] Traza en " << traza << "\n";
+        else cerr << "[AVISO] No se pudo escribir la traza " << traza << "\n";
     }
-    if (denoiserPtr) delete denoiserPtr;
 }
 
-// ======================================================================================
-// MAIN
-// ======================================================================================
 int main(int argc, char** argv) {
+    // --- COMPROBACIÓN NLMEANS ---
+    if (argc == 3 && string(argv[1]) == "--nlm-check") {
+        try { return comprobarNLMeans(argv[2]); }
+        catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 1; }
+    }
+
+    // --- COMPROBACIÓN MORFOLOGÍA ---
+    if ((argc == 2 || argc == 3) && string(argv[1]) == "--morph-check") {
+        try { return comprobarMorfologia(argc == 3 ? argv[2] : ""); }
+        catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 1; }
+    }
+
+    // --- COMPROBACIÓN DNCNN (TESELAS E INT8) ---
+    if (argc >= 2 && argc <= 4 && string(argv[1]) == "--dnn-check") {
+        const BatchOptions defecto;
+        const string serie = argc >= 3 ? argv[2] : defecto.calibrationDir;
+        // Los tiempos de forward dependen de los hilos de OpenCV (por defecto, los suyos)
+        DnnThreadsScope hilosDnn(argc == 4 ? atoi(argv[3]) : 0);
+        try {
+            const int teselas = comprobarDnnTeselas(defecto.modelPath, serie, 128);
+            const int int8 = comprobarDnnInt8(defecto.modelPath, serie, defecto.calibrationSlices);
+            return teselas || int8;
+        }
+        catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 1; }
+    }
+
+    // --- CONVERSIÓN A VOLUMEN HUV (mmap) ---
+    if ((argc == 3 || argc == 4) && string(argv[1]) == "--convert") {
+        const string destino = argc == 4 ? argv[3] : defaultHUVolumePath(argv[2]);
+        try {
+            TickMeter t;
+            t.start();
+            convertSeriesToHUVolume(argv[2], destino);
+            t.stop();
+            cout << "[CONVERSION] " << destino << " (" << t.getTimeSec() << " s)\n";
+            return comprobarVolumenHUV(argv[2], destino);
+        } catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 1; }
+    }
+
+    // --- ÍNDICE DICOM PERSISTENTE ---
+    if (argc == 3 && string(argv[1]) == "--index") {
+        try { return indexarArbol(argv[2]); }
+        catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 1; }
+    }
+
+    // --- SEGMENTACIÓN VOLUMÉTRICA ---
+    if ((argc == 3 || argc == 4) && string(argv[1]) == "--segment3d") {
+        const size_t presupuesto = argc == 4 ? (size_t)max(1, atoi(argv[3])) : 512;
+        try { return segmentarVolumen(argv[2], presupuesto); }
+        catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 1; }
+    }
+
+    // --- COMPROBACIÓN SEGMENTACIÓN 3D (SLABS) ---
+    if ((argc == 2 || argc == 3) && string(argv[1]) == "--seg3d-check") {
+        try { return comprobarSegmentacion3D(argc == 3 ? argv[2] : BatchOptions().calibrationDir); }
+        catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 1; }
+    }
+
+    // --- OPCIONES DE LÍNEA DE COMANDOS ---
+    BatchOptions opt;
+    string perfilBase, trazaPath;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--batch" && hasValue) opt.dicomDir = argv[++i];
+        else if (arg == "--out" && hasValue) opt.outputDir = argv[++i];
+        else if (arg == "--threads" && hasValue) opt.threads = (unsigned)max(0, atoi(argv[++i]));
+        else if (arg == "--model" && hasValue) opt.modelPath = argv[++i];
+        else if (arg == "--dnn-batch" && hasValue) opt.dnnBatch = (unsigned)max(1, atoi(argv[++i]));
+        else if (arg == "--dnn-tile" && hasValue) opt.dnnTile = max(0, atoi(argv[++i]));
+        else if (arg == "--outputs" && hasValue) {
+            try { opt.outputs = parseOutputList(argv[++i]); }
+            catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 2; }
+        }
+        else if (arg == "--format" && hasValue) {
+            try { opt.writer.format = parseOutputFormat(argv[++i]); }
+            catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 2; }
+        }
+        else if (arg == "--compression" && hasValue) opt.writer.pngCompression = atoi(argv[++i]);
+        else if (arg == "--writers" && hasValue) opt.writer.threads = (unsigned)max(1, atoi(argv[++i]));
+        else if (arg == "--decode-threads" && hasValue) opt.decodeThreads = (unsigned)max(1, atoi(argv[++i]));
+        else if (arg == "--dnn-threads" && hasValue) opt.dnnThreads = max(1, atoi(argv[++i]));
+        else if (arg == "--queue" && hasValue) opt.queueDepth = (unsigned)max(1, atoi(argv[++i]));
+        else if (arg == "--precision" && hasValue) {
+            try { opt.dnnPrecision = parseDnnPrecision(argv[++i]); }
+            catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 2; }
+        }
+        else if (arg == "--calib" && hasValue) opt.calibrationDir = argv[++i];
+        else if (arg == "--calib-slices" && hasValue) opt.calibrationSlices = (unsigned)max(2, atoi(argv[++i]));  // al menos una para validar
+        else if (arg == "--nlm" && hasValue) {
+            try { opt.nlmEngine = parseNLMeansEngine(argv[++i]); }
+            catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 2; }
+        }
+        else if (arg == "--windows" && hasValue) {
+            try { opt.extraWindows = parseWindowList(argv[++i]); }
+            catch (const std::exception& e) { cerr << "Error: " << e.what() << endl; return 2; }
+        }
+        else if (arg == "--profile" && hasValue) perfilBase = argv[++i];
+        else if (arg == "--trace" && hasValue) trazaPath = argv[++i];
+        else { imprimirUso(argv[0]); return 2; }
+    }
+
+    if (!perfilBase.empty() || !trazaPath.empty()) {
+        Profiler::instance().setTraceEnabled(!trazaPath.empty());
+        Profiler::instance().setEnabled(true);
+    }
+
+    // --- MODO BATCH (sin GUI) ---
+    if (!opt.dicomDir.empty()) {
+        int rc = 1;
+        try {
+            rc = runBatch(opt);
+        } catch (const std::exception& e) {
+            cerr << "Error: " << e.what() << endl;
+        }
+        escribirPerfil(perfilBase, trazaPath);
+        return rc;
+    }
+    // Opciones de batch sin --batch: uso incorrecto (el perfilado y los hilos
+    // de DnCNN sí valen en modo interactivo)
+    const int argsInteractivo = (perfilBase.empty() ? 0 : 2) + (trazaPath.empty() ? 0 : 2) +
+                                (opt.dnnThreads > 0 ? 2 : 0);
+    if (argc - 1 > argsInteractivo) { imprimirUso(argv[0]); return 2; }
+    // Selector y navegador: todos sus forward con los mismos hilos de OpenCV
+    DnnThreadsScope hilosDnn(opt.dnnThreads);
+
     while (true) {
         Mat menu = Mat::zeros(Size(600, 300), CV_8UC3);
         putText(menu, "GENERADOR FINAL (12 IMAGENES)", Point(30, 50), FONT_HERSHEY_SIMPLEX, 0.8, Scalar(0, 255, 255), 2);
         putText(menu, "[O] Abrir IMAGEN (.IMA/.dcm)", Point(50, 120), FONT_HERSHEY_SIMPLEX, 0.7, Scalar(255, 255, 255), 1);
-        putText(menu, "[ESC] Salir", Point(50, 170), FONT_HERSHEY_SIMPLEX, 0.7, Scalar(100, 100, 255), 1);
+        putText(menu, "[N] Navegar serie (flechas + ventana)", Point(50, 170), FONT_HERSHEY_SIMPLEX, 0.7, Scalar(255, 255, 255), 1);
+        putText(menu, "[ESC] Salir", Point(50, 220), FONT_HERSHEY_SIMPLEX, 0.7, Scalar(100, 100, 255), 1);
         
         imshow("Menu Principal", menu);
         int key = waitKey(0);
@@ -226,6 +633,12 @@ int main(int argc, char** argv) {
             string archivo = abrirSelectorDeArchivo();
             if (!archivo.empty()) procesarArchivoSeleccionado(archivo);
         }
+        if (key == 'n' || key == 'N') {
+            destroyWindow("Menu Principal");
+            string archivo = abrirSelectorDeArchivo();
+            if (!archivo.empty()) navegarSerie(archivo);
+        }
     }
+    escribirPerfil(perfilBase, trazaPath);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "morphology.hpp"
+#include "buffer_pool.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace cv;
+
+namespace {
+
+// Fila del elemento estructurante: desplazamiento vertical y semiancho
+struct RowSpan {
+  int dy;
+  int r;
+};
+
+struct Decomposition {
+  std::vector<RowSpan> spans;
+  std::vector<int> radii;  // semianchos distintos
+  bool rect = false;       // todas las filas iguales → separable
+  int R = 0;               // semialtura
+};
+
+bool decompose(const Mat& kernel, Decomposition& d) {
+  if (kernel.empty() || kernel.type() != CV_8U || !(kernel.rows & 1) || !(kernel.cols & 1))
+    return false;
+  const int ax = kernel.cols / 2, ay = kernel.rows / 2;
+  d.R = ay;
+  for (int i = 0; i < kernel.rows; ++i) {
+    const uchar* k = kernel.ptr<uchar>(i);
+    int j1 = -1, j2 = -1;
+    for (int j = 0; j < kernel.cols; ++j) {
+      if (!k[j]) continue;
+      if (j1 < 0) j1 = j;
+      else if (j != j2 + 1) return false;  // fila no contigua
+      j2 = j;
+    }
+    if (j1 < 0) continue;                 // fila vacía
+    if (j1 + j2 != 2 * ax) return false;  // fila no centrada
+    d.spans.push_back({ i - ay, ax - j1 });
+  }
+  if (d.spans.empty()) return false;
+
+  for (const auto& s : d.spans)
+    if (std::find(d.radii.begin(), d.radii.end(), s.r) == d.radii.end()) d.radii.push_back(s.r);
+  d.rect = d.radii.size() == 1 && (int)d.spans.size() == kernel.rows;
+  return true;
+}
+
+constexpr int kDirectMaxRadius = 2;  // hasta 5 píxeles: comparación directa
+
+struct MinOp {
+  static constexpr uchar neutral = 255;
+  static uchar apply(uchar a, uchar b) { return std::min(a, b); }
+};
+struct MaxOp {
+  static constexpr uchar neutral = 0;
+  static uchar apply(uchar a, uchar b) { return std::max(a, b); }
+};
+
+// Mínimo/máximo 1D en [x - r, x + r] recortado a [0, n).
+template <class Op>
+void line1D(const uchar* s, uchar* out, int n, int r, std::vector<uchar>& buf) {
+  if (r == 0) {
+    std::copy(s, s + n, out);
+    return;
+  }
+  if (r <= kDirectMaxRadius) {
+    for (int x = 0; x < n; ++x) {
+      const int lo = std::max(0, x - r), hi = std::min(n - 1, x + r);
+      uchar v = s[lo];
+      for (int k = lo + 1; k <= hi; ++k) v = Op::apply(v, s[k]);
+      out[x] = v;
+    }
+    return;
+  }
+
+  // van Herk/Gil-Werman: bloques de w = 2r+1, prefijos g y sufijos h
+  const int w = 2 * r + 1, L = n + 2 * r;
+  buf.resize(3 * (size_t)L);
+  uchar* ext = buf.data();
+  uchar* g = ext + L;
+  uchar* h = g + L;
+  std::fill(ext, ext + r, Op::neutral);
+  std::copy(s, s + n, ext + r);
+  std::fill(ext + r + n, ext + L, Op::neutral);
+
+  for (int i = 0; i < L; ++i) g[i] = (i % w == 0) ? ext[i] : Op::apply(g[i - 1], ext[i]);
+  for (int i = L - 1; i >= 0; --i)
+    h[i] = (i == L - 1 || (i + 1) % w == 0) ? ext[i] : Op::apply(h[i + 1], ext[i]);
+  for (int x = 0; x < n; ++x) out[x] = Op::apply(h[x], g[x + w - 1]);
+}
+
+// Una fila de la pasada vertical genérica:
+// o = op sobre los segmentos (dy, r) de H_r(y + dy), ignorando filas de fuera.
+template <class Op>
+void verticalRow(const std::map<int, Mat>& H, const Decomposition& d, int y, uchar* o) {
+  const int rows = H.begin()->second.rows, cols = H.begin()->second.cols;
+  bool first = true;
+  for (const auto& s : d.spans) {
+    const int yy = y + s.dy;
+    if (yy < 0 || yy >= rows) continue;
+    const uchar* h = H.at(s.r).ptr<uchar>(yy);
+    if (first) { std::copy(h, h + cols, o); first = false; continue; }
+    for (int x = 0; x < cols; ++x) o[x] = Op::apply(o[x], h[x]);
+  }
+  if (first) std::fill(o, o + cols, Op::neutral);
+}
+
+// Pasada vertical van Herk/Gil-Werman para kernels rectangulares altos,
+// trabajando con filas completas (acceso contiguo).
+template <class Op>
+void verticalVHGW(const Mat& H, Mat& dst, int R) {
+  const int rows = H.rows, cols = H.cols;
+  const int w = 2 * R + 1, L = rows + 2 * R;
+  BufferPool& pool = threadBufferPool();
+  Mat g = pool.acquire(Size(cols, L), CV_8U), h = pool.acquire(Size(cols, L), CV_8U);
+  auto ext = [&](int e) -> const uchar* { return (e < R || e >= rows + R) ? nullptr : H.ptr<uchar>(e - R); };
+
+  for (int e = 0; e < L; ++e) {
+    const uchar* s = ext(e);
+    uchar* ge = g.ptr<uchar>(e);
+    if (e % w == 0) {
+      if (s) std::copy(s, s + cols, ge); else std::fill(ge, ge + cols, Op::neutral);
+    } else {
+      const uchar* gp = g.ptr<uchar>(e - 1);
+      if (s) for (int x = 0; x < cols; ++x) ge[x] = Op::apply(gp[x], s[x]);
+      else std::copy(gp, gp + cols, ge);
+    }
+  }
+  for (int e = L - 1; e >= 0; --e) {
+    const uchar* s = ext(e);
+    uchar* he = h.ptr<uchar>(e);
+    if (e == L - 1 || (e + 1) % w == 0) {
+      if (s) std::copy(s, s + cols, he); else std::fill(he, he + cols, Op::neutral);
+    } else {
+      const uchar* hn = h.ptr<uchar>(e + 1);
+      if (s) for (int x = 0; x < cols; ++x) he[x] = Op::apply(hn[x], s[x]);
+      else std::copy(hn, hn + cols, he);
+    }
+  }
+
+  dst.create(H.size(), CV_8U);
+  for (int y = 0; y < rows; ++y) {
+    const uchar* a = h.ptr<uchar>(y);
+    const uchar* b = g.ptr<uchar>(y + w - 1);
+    uchar* o = dst.ptr<uchar>(y);
+    for (int x = 0; x < cols; ++x) o[x] = Op::apply(a[x], b[x]);
+  }
+}
+
+// Mínimo de sMin y máximo de sMax fusionados: cada fila se filtra con ambos
+// operadores seguidos (la fila de entrada ya está en caché para el segundo).
+// Cualquiera de los pares (sMin, dMin) / (sMax, dMax) puede ser nulo.
+void fusedFilter(const Mat* sMin, const Mat* sMax, Mat* dMin, Mat* dMax, const Decomposition& d) {
+  const Mat& ref = sMin ? *sMin : *sMax;
+  const int rows = ref.rows, cols = ref.cols;
+
+  BufferPool& pool = threadBufferPool();
+  std::map<int, Mat> Hmin, Hmax;
+  for (int r : d.radii) {
+    if (sMin) Hmin[r] = pool.acquire(ref.size(), CV_8U);
+    if (sMax) Hmax[r] = pool.acquire(ref.size(), CV_8U);
+  }
+
+  // 1. Pasada horizontal (una por semiancho distinto)
+  parallel_for_(Range(0, rows), [&](const Range& rg) {
+    std::vector<uchar> buf;
+    for (int y = rg.start; y < rg.end; ++y) {
+      for (int r : d.radii) {
+        if (sMin) line1D<MinOp>(sMin->ptr<uchar>(y), Hmin.at(r).ptr<uchar>(y), cols, r, buf);
+        if (sMax) line1D<MaxOp>(sMax->ptr<uchar>(y), Hmax.at(r).ptr<uchar>(y), cols, r, buf);
+      }
+    }
+  });
+
+  // 2. Pasada vertical
+  if (d.rect && d.R > kDirectMaxRadius) {
+    if (sMin) verticalVHGW<MinOp>(Hmin.begin()->second, *dMin, d.R);
+    if (sMax) verticalVHGW<MaxOp>(Hmax.begin()->second, *dMax, d.R);
+    return;
+  }
+  if (sMin) dMin->create(ref.size(), CV_8U);
+  if (sMax) dMax->create(ref.size(), CV_8U);
+  parallel_for_(Range(0, rows), [&](const Range& rg) {
+    for (int y = rg.start; y < rg.end; ++y) {
+      if (sMin) verticalRow<MinOp>(Hmin, d, y, dMin->ptr<uchar>(y));
+      if (sMax) verticalRow<MaxOp>(Hmax, d, y, dMax->ptr<uchar>(y));
+    }
+  });
+}
+
+bool supported(const Mat* srcMin, const Mat* srcMax, const Mat& kernel, Decomposition& d) {
+  if (srcMin && srcMin->type() != CV_8UC1) return false;
+  if (srcMax && srcMax->type() != CV_8UC1) return false;
+  return decompose(kernel, d);
+}
+
+}  // namespace
+
+void minMaxFilter(const Mat& srcMin, const Mat& srcMax, Mat* dstMin, Mat* dstMax, const Mat& kernel) {
+  Decomposition d;
+  if (!supported(dstMin ? &srcMin : nullptr, dstMax ? &srcMax : nullptr, kernel, d)) {
+    if (dstMin) erode(srcMin, *dstMin, kernel);
+    if (dstMax) dilate(srcMax, *dstMax, kernel);
+    return;
+  }
+
+  CV_Assert(!dstMin || !dstMax || srcMin.size() == srcMax.size());
+  // dst es del llamador: se escribe directamente en él salvo que comparta
+  // buffer con una entrada (p.ej. erodeFast(a, a, k)); en ese caso, en un
+  // buffer del pool que después pasa a dst
+  const Size size = (dstMin ? srcMin : srcMax).size();
+  BufferPool& pool = threadBufferPool();
+  auto target = [&](Mat* dst) -> Mat {
+    if (!dst) return Mat();
+    if (dst->data && (dst->datastart == srcMin.datastart || dst->datastart == srcMax.datastart))
+      return pool.acquire(size, CV_8U);
+    pool.ensure(*dst, size, CV_8U);
+    return *dst;
+  };
+  Mat outMin = target(dstMin), outMax = target(dstMax);
+  fusedFilter(dstMin ? &srcMin : nullptr, dstMax ? &srcMax : nullptr,
+              dstMin ? &outMin : nullptr, dstMax ? &outMax : nullptr, d);
+  if (dstMin) *dstMin = outMin;
+  if (dstMax) *dstMax = outMax;
+}
+
+void erodeFast(const Mat& src, Mat& dst, const Mat& kernel) { minMaxFilter(src, src, &dst, nullptr, kernel); }
+void dilateFast(const Mat& src, Mat& dst, const Mat& kernel) { minMaxFilter(src, src, nullptr, &dst, kernel); }
+
+void morphOpenFast(const Mat& src, Mat& dst, const Mat& kernel) {
+  Mat e = threadBufferPool().acquire(src.size(), CV_8U);
+  erodeFast(src, e, kernel);
+  dilateFast(e, dst, kernel);
+}
+
+void morphCloseFast(const Mat& src, Mat& dst, const Mat& kernel) {
+  Mat di = threadBufferPool().acquire(src.size(), CV_8U);
+  dilateFast(src, di, kernel);
+  erodeFast(di, dst, kernel);
+}
+
+void morphAll(const Mat& src, const Mat& kernel, MorphSet& out) {
+  // 1. erode + dilate (un barrido min/max sobre src)
+  minMaxFilter(src, src, &out.erode, &out.dilate, kernel);
+
+  // 2. apertura = max(erode) y cierre = min(dilate), también en un barrido
+  BufferPool& pool = threadBufferPool();
+  Mat opened = pool.acquire(src.size(), CV_8U), closed = pool.acquire(src.size(), CV_8U);
+  minMaxFilter(out.dilate, out.erode, &closed, &opened, kernel);
+
+  // 3. tophat = src - apertura, blackhat = cierre - src (con saturación)
+  pool.ensure(out.tophat, src.size(), CV_8U);
+  pool.ensure(out.blackhat, src.size(), CV_8U);
+  subtract(src, opened, out.tophat);
+  subtract(closed, src, out.blackhat);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <opencv2/core.hpp>
+
+// Motor de morfología en escala de grises (CV_8UC1).
+// El elemento estructurante se descompone en segmentos horizontales simétricos
+// (rectángulo, cruz, elipse de getStructuringElement): cada fila se filtra con
+// un mínimo/máximo 1D y las filas se combinan en vertical. Los segmentos de
+// más de 5 píxeles usan van Herk/Gil-Werman (3 comparaciones por píxel sea
+// cual sea el tamaño). Los bordes se tratan como en cv::erode/cv::dilate con
+// el valor de borde por defecto (los píxeles de fuera se ignoran).
+// Kernels no descomponibles o tipos distintos de CV_8UC1 pasan a OpenCV.
+
+// Las cuatro salidas del grupo B a partir de un solo par de filtros min/max:
+// erode = min(src), dilate = max(src), tophat = src - max(erode),
+// blackhat = min(dilate) - src. Un barrido fusionado calcula erode+dilate y
+// otro apertura+cierre (frente a ~6 filtros con morphologyEx por separado).
+struct MorphSet {
+  cv::Mat erode;
+  cv::Mat dilate;
+  cv::Mat tophat;
+  cv::Mat blackhat;
+};
+void morphAll(const cv::Mat& src, const cv::Mat& kernel, MorphSet& out);
+
+// Barrido fusionado: mínimo de srcMin y máximo de srcMax en la misma pasada.
+// Cualquiera de las salidas puede ser nullptr.
+void minMaxFilter(const cv::Mat& srcMin, const cv::Mat& srcMax,
+                  cv::Mat* dstMin, cv::Mat* dstMax, const cv::Mat& kernel);
+
+void erodeFast(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel);
+void dilateFast(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel);
+void morphOpenFast(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel);
+void morphCloseFast(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel);
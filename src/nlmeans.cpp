@@ -0,0 +1,208 @@
+#include "nlmeans.hpp"
+#include "buffer_pool.hpp"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/photo.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+using namespace cv;
+
+namespace {
+
+// Peso exp(-d/h^2) tabulado; por encima de kMaxRatio el peso (< 0.001) se anula.
+constexpr int kLutSize = 1024;
+constexpr float kMaxRatio = 6.9f;
+
+struct WeightLUT {
+  float w[kLutSize];
+  WeightLUT() {
+    for (int i = 0; i < kLutSize; ++i) w[i] = std::exp(-(i + 0.5f) * kMaxRatio / kLutSize);
+  }
+};
+
+const WeightLUT& weightLUT() {
+  static const WeightLUT lut;
+  return lut;
+}
+
+struct Progress {
+  const std::function<void(float)>* cb;
+  size_t total;
+  std::atomic<size_t> done{0};
+  std::atomic<int> lastDecile{0};
+
+  void step() {
+    if (!cb || !*cb) return;
+    const size_t d = ++done;
+    const int decile = (int)(d * 10 / total);
+    int prev = lastDecile.load();
+    while (decile > prev) {
+      if (lastDecile.compare_exchange_weak(prev, decile)) { (*cb)(decile / 10.0f); break; }
+    }
+  }
+};
+
+// Franja de filas [r0, r1) de la salida. padded: slices CV_32F con borde
+// reflejado de m = hs + hp píxeles; acc: salida CV_32F de tamaño completo.
+void nlmStrip(const std::vector<Mat>& padded, size_t centerIdx, int r0, int r1, int W,
+              const NLMeansParams& p, Mat& acc, Progress& progress) {
+  const int hs = p.searchWindow / 2, hp = p.templateWindow / 2;
+  const int m = hs + hp, T = 2 * hp + 1;
+  const int rows = r1 - r0;
+  const float invT2 = 1.0f / (T * T);
+  const float h = std::max(1e-3f, p.h);
+  const float lutScale = kLutSize / (kMaxRatio * h * h);  // d (media por píxel) → índice
+  const float* lut = weightLUT().w;
+
+  // Buffers del pool del hilo de la franja: sin reservas en régimen estacionario
+  BufferPool& pool = threadBufferPool();
+  Mat D = pool.acquire(Size(W + 2 * hp, rows + 2 * hp), CV_32F);
+  Mat I = pool.acquire(Size(D.cols + 1, D.rows + 1), CV_64F);
+  Mat sumW = pool.acquireZeros(Size(W, rows), CV_32F), sumV = pool.acquireZeros(Size(W, rows), CV_32F);
+
+  const Mat& C = padded[centerIdx];
+
+  for (const Mat& P : padded) {
+    for (int dy = -hs; dy <= hs; ++dy) {
+      for (int dx = -hs; dx <= hs; ++dx) {
+        // Diferencias al cuadrado centro vs desplazado, con el halo del parche
+        for (int yy = 0; yy < D.rows; ++yy) {
+          const float* c = C.ptr<float>(r0 - hp + yy + m) + (m - hp);
+          const float* q = P.ptr<float>(r0 - hp + yy + m + dy) + (m - hp + dx);
+          float* d = D.ptr<float>(yy);
+          for (int xx = 0; xx < D.cols; ++xx) {
+            const float t = c[xx] - q[xx];
+            d[xx] = t * t;
+          }
+        }
+        integral(D, I, CV_64F);
+
+        // SSD de cada parche con 4 accesos a la integral → peso → acumulación
+        for (int y = 0; y < rows; ++y) {
+          const double* i0 = I.ptr<double>(y);
+          const double* i1 = I.ptr<double>(y + T);
+          const float* v = P.ptr<float>(r0 + y + m + dy) + (m + dx);
+          float* sw = sumW.ptr<float>(y);
+          float* sv = sumV.ptr<float>(y);
+          for (int x = 0; x < W; ++x) {
+            const float ssd = (float)(i1[x + T] - i1[x] - i0[x + T] + i0[x]);
+            const int idx = (int)(std::max(0.0f, ssd * invT2) * lutScale);
+            if (idx >= kLutSize) continue;
+            const float w = lut[idx];
+            sw[x] += w;
+            sv[x] += w * v[x];
+          }
+        }
+        progress.step();
+      }
+    }
+  }
+
+  // El desplazamiento (0,0) del slice central siempre aporta peso > 0
+  for (int y = 0; y < rows; ++y) {
+    const float* sw = sumW.ptr<float>(y);
+    const float* sv = sumV.ptr<float>(y);
+    float* o = acc.ptr<float>(r0 + y);
+    for (int x = 0; x < W; ++x) o[x] = sv[x] / sw[x];
+  }
+}
+
+void nlmRun(const std::vector<Mat>& slices, size_t centerIdx, Mat& dst, const NLMeansParams& pIn) {
+  CV_Assert(!slices.empty() && centerIdx < slices.size());
+  const Mat& src = slices[centerIdx];
+  CV_Assert(src.channels() == 1 && (src.depth() == CV_8U || src.depth() == CV_32F));
+
+  NLMeansParams p = pIn;
+  p.templateWindow = std::max(1, p.templateWindow | 1);
+  p.searchWindow = std::max(1, p.searchWindow | 1);
+  const int m = p.searchWindow / 2 + p.templateWindow / 2;
+
+  BufferPool& pool = threadBufferPool();
+  std::vector<Mat> padded(slices.size());
+  for (size_t i = 0; i < slices.size(); ++i) {
+    CV_Assert(slices[i].size() == src.size() && slices[i].type() == src.type());
+    Mat f = slices[i];
+    if (f.depth() != CV_32F) {
+      f = pool.acquire(src.size(), CV_32F);
+      slices[i].convertTo(f, CV_32F);
+    }
+    padded[i] = pool.acquire(Size(src.cols + 2 * m, src.rows + 2 * m), CV_32F);
+    copyMakeBorder(f, padded[i], m, m, m, m, BORDER_REFLECT_101);
+  }
+
+  const int H = src.rows, W = src.cols;
+  const int nStripes = std::max(1, std::min(H, p.threads > 0 ? p.threads : getNumThreads()));
+  const int S = p.searchWindow;
+
+  Progress progress;
+  progress.cb = &p.progress;
+  progress.total = (size_t)nStripes * padded.size() * S * S;
+
+  Mat acc = pool.acquire(src.size(), CV_32F);
+  parallel_for_(Range(0, nStripes), [&](const Range& r) {
+    for (int s = r.start; s < r.end; ++s) {
+      const int r0 = (int)((int64)H * s / nStripes);
+      const int r1 = (int)((int64)H * (s + 1) / nStripes);
+      nlmStrip(padded, centerIdx, r0, r1, W, p, acc, progress);
+    }
+  }, nStripes);
+
+  acc.convertTo(dst, src.type());
+}
+
+}  // namespace
+
+NLMeansEngine parseNLMeansEngine(const std::string& name) {
+  if (name == "opencv") return NLMeansEngine::OpenCV;
+  if (name == "fast") return NLMeansEngine::Fast;
+  if (name == "fast3d") return NLMeansEngine::Fast3D;
+  if (name == "fasthu") return NLMeansEngine::FastHU;
+  throw std::runtime_error("Motor NLMeans desconocido (opencv|fast|fast3d|fasthu): " + name);
+}
+
+const char* nlmEngineName(NLMeansEngine e) {
+  switch (e) {
+    case NLMeansEngine::Fast: return "fast";
+    case NLMeansEngine::Fast3D: return "fast3d";
+    case NLMeansEngine::FastHU: return "fasthu";
+    default: return "opencv";
+  }
+}
+
+void fastNlMeansCT(const Mat& src, Mat& dst, const NLMeansParams& p) {
+  nlmRun({ src }, 0, dst, p);
+}
+
+void fastNlMeansCT3D(const std::vector<Mat>& slices, int center, Mat& dst,
+                     const NLMeansParams& p, int zRadius) {
+  CV_Assert(center >= 0 && center < (int)slices.size());
+  const int z0 = std::max(0, center - zRadius);
+  const int z1 = std::min((int)slices.size() - 1, center + zRadius);
+  std::vector<Mat> neighbours(slices.begin() + z0, slices.begin() + z1 + 1);
+  nlmRun(neighbours, (size_t)(center - z0), dst, p);
+}
+
+NLMeansComparison compareWithOpenCVNLMeans(const Mat& src8u, const NLMeansParams& p) {
+  return compareWithOpenCVNLMeans(std::vector<Mat>{ src8u }, 0, p);
+}
+
+NLMeansComparison compareWithOpenCVNLMeans(const std::vector<Mat>& slices8u, int center,
+                                           const NLMeansParams& p) {
+  CV_Assert(center >= 0 && center < (int)slices8u.size() && slices8u[center].type() == CV_8UC1);
+  NLMeansComparison r;
+  Mat fast;
+  TickMeter t;
+  t.start();
+  fastNlMeansDenoising(slices8u[center], r.reference, 10.0f, 7, 21);
+  t.stop();
+  r.openCVMs = t.getTimeMilli();
+  t.reset();
+  t.start();
+  fastNlMeansCT3D(slices8u, center, fast, p);
+  t.stop();
+  r.fastMs = t.getTimeMilli();
+  r.psnr = PSNR(r.reference, fast);
+  return r;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+// NLMeans rápido para CT. La distancia entre parches se obtiene para cada
+// desplazamiento de búsqueda con una imagen integral de diferencias al
+// cuadrado (coste independiente del tamaño del parche) y la imagen se reparte
+// en franjas horizontales que se procesan en paralelo.
+struct NLMeansParams {
+  float h = 10.0f;          // fuerza del filtro, en unidades de la imagen (gris u HU)
+  int templateWindow = 7;   // lado del parche (impar)
+  int searchWindow = 11;    // lado de la ventana de búsqueda (impar); 21 en OpenCV
+  int threads = 0;          // franjas en paralelo (0 = cv::getNumThreads())
+  // Progreso en [0,1], llamado desde los hilos de trabajo cada ~10 %.
+  std::function<void(float)> progress;
+};
+
+// PSNR mínimo frente a la referencia cv::fastNlMeansDenoising(src, dst, 10, 7, 21)
+// sobre el slice ventaneado 40/400. Medido en L096 (full_3mm_sharp, 330
+// slices; 21 repartidos del segundo al penúltimo): búsqueda 21 => 74-82 dB (misma
+// aproximación que OpenCV); búsqueda 11 => mínimo 42.1 dB, media 46.2; 3D
+// (±1 slice) con búsqueda 11 => mínimo 46.7 dB, media 49.5. 40 dB deja ~2 dB
+// de margen bajo el peor slice medido. El pipeline usa la referencia salvo
+// que se pida un motor rápido, y entonces solo si este lo supera en el slice
+// central de la serie (--nlm-check lo mide en cualquier slice).
+constexpr double kNLMeansMinPSNR = 40.0;
+
+// h en HU equivalente a h = 10 sobre la ventana 40/400 (10 grises de 255)
+constexpr float kNLMeansStrengthHU = 10.0f * 400.0f / 255.0f;
+
+// Cómo se calcula la salida 3 (NLMeans)
+enum class NLMeansEngine {
+  OpenCV,  // cv::fastNlMeansDenoising(10, 7, 21) sobre la ventana (referencia)
+  Fast,    // fastNlMeansCT sobre la ventana
+  Fast3D,  // fastNlMeansCT3D sobre la ventana del slice y sus vecinos z-1, z+1
+  FastHU,  // fastNlMeansCT sobre el HU y después la ventana (no depende de ella)
+};
+
+// "opencv" / "fast" / "fast3d" / "fasthu" -> NLMeansEngine. Lanza
+// std::runtime_error si no lo reconoce.
+NLMeansEngine parseNLMeansEngine(const std::string& name);
+const char* nlmEngineName(NLMeansEngine e);
+
+// src CV_8U o CV_32F (un canal); dst del mismo tipo.
+void fastNlMeansCT(const cv::Mat& src, cv::Mat& dst, const NLMeansParams& p = NLMeansParams());
+
+// Variante 3D: los parches candidatos se buscan también en los slices vecinos
+// (center ± zRadius, recortado a los disponibles). Todos del mismo tamaño y tipo.
+void fastNlMeansCT3D(const std::vector<cv::Mat>& slices, int center, cv::Mat& dst,
+                     const NLMeansParams& p = NLMeansParams(), int zRadius = 1);
+
+struct NLMeansComparison {
+  double psnr = 0.0;      // dB, fastNlMeansCT frente a la referencia de OpenCV
+  double openCVMs = 0.0;
+  double fastMs = 0.0;
+  cv::Mat reference;      // salida de la referencia
+};
+
+// Ejecuta la referencia de OpenCV y fastNlMeansCT(p) sobre src8u (CV_8UC1).
+NLMeansComparison compareWithOpenCVNLMeans(const cv::Mat& src8u, const NLMeansParams& p = NLMeansParams());
+// Igual con fastNlMeansCT3D sobre slices8u (ventaneados igual); la referencia
+// es la de OpenCV sobre slices8u[center].
+NLMeansComparison compareWithOpenCVNLMeans(const std::vector<cv::Mat>& slices8u, int center,
+                                           const NLMeansParams& p = NLMeansParams());
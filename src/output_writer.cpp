@@ -0,0 +1,139 @@
+#include "output_writer.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <opencv2/imgcodecs.hpp>
+
+using namespace cv;
+
+OutputFormat parseOutputFormat(const std::string& name) {
+  if (name == "png") return OutputFormat::PNG;
+  if (name == "tiff" || name == "tif") return OutputFormat::TIFF;
+  if (name == "raw") return OutputFormat::RAW;
+  throw std::runtime_error("Formato de salida desconocido (png, tiff, raw): " + name);
+}
+
+const char* outputFormatExtension(OutputFormat f) {
+  switch (f) {
+    case OutputFormat::PNG: return ".png";
+    case OutputFormat::TIFF: return ".tiff";
+    case OutputFormat::RAW: return ".raw";
+  }
+  return "";
+}
+
+OutputWriter::OutputWriter(const WriterOptions& opt) : opt_(opt) {
+  opt_.threads = std::max(1u, opt_.threads);
+  opt_.maxQueued = std::max<size_t>(1, opt_.maxQueued);
+
+  if (opt_.format == OutputFormat::PNG)
+    encodeParams_ = {IMWRITE_PNG_COMPRESSION, std::clamp(opt_.pngCompression, 0, 9)};
+  else if (opt_.format == OutputFormat::TIFF)
+    encodeParams_ = {IMWRITE_TIFF_COMPRESSION, 1};  // 1 = sin compresión
+
+  workers_.reserve(opt_.threads);
+  for (unsigned i = 0; i < opt_.threads; ++i) workers_.emplace_back([this] { workerLoop(); });
+}
+
+OutputWriter::~OutputWriter() {
+  flush();
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    stop_ = true;
+  }
+  notEmpty_.notify_all();
+  for (auto& t : workers_) t.join();
+}
+
+void OutputWriter::write(const std::string& basePath, Mat image) {
+  std::unique_lock<std::mutex> lk(m_);
+  if (queue_.size() >= opt_.maxQueued) {
+    const auto t0 = std::chrono::steady_clock::now();
+    notFull_.wait(lk, [this] { return queue_.size() < opt_.maxQueued; });
+    stats_.blockedMs += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - t0).count();
+  }
+  queue_.push_back({basePath, std::move(image)});
+  ++inFlight_;
+  stats_.peakQueued = std::max(stats_.peakQueued, queue_.size());
+  lk.unlock();
+  notEmpty_.notify_one();
+}
+
+WriterStats OutputWriter::flush() {
+  std::unique_lock<std::mutex> lk(m_);
+  idle_.wait(lk, [this] { return inFlight_ == 0; });
+  return stats_;
+}
+
+WriterStats OutputWriter::stats() const {
+  std::lock_guard<std::mutex> lk(m_);
+  return stats_;
+}
+
+bool OutputWriter::writeJob(const Job& job, std::uint64_t& bytes) const {
+  PROFILE_SCOPE("image_encode");
+  const Mat& img = job.image;
+  std::string path = job.basePath;
+
+  if (opt_.format == OutputFormat::RAW) {
+    path += "_" + std::to_string(img.cols) + "x" + std::to_string(img.rows) + "x" +
+            std::to_string(img.channels()) + outputFormatExtension(opt_.format);
+    std::ofstream f(path, std::ios::binary);
+    const size_t rowBytes = img.cols * img.elemSize();
+    for (int y = 0; y < img.rows; ++y) f.write(img.ptr<char>(y), rowBytes);
+    bytes = rowBytes * img.rows;
+    return (bool)f;
+  }
+
+  // Codificación en memoria + una sola escritura: así se conoce el tamaño final
+  std::vector<uchar> buf;
+  const char* ext = outputFormatExtension(opt_.format);
+  if (!imencode(ext, img, buf, encodeParams_)) return false;
+  path += ext;
+  std::ofstream f(path, std::ios::binary);
+  f.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+  bytes = buf.size();
+  return (bool)f;
+}
+
+void OutputWriter::workerLoop() {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lk(m_);
+      notEmpty_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) return;  // stop_ y nada pendiente
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    notFull_.notify_one();
+
+    const auto t0 = std::chrono::steady_clock::now();
+    std::uint64_t bytes = 0;
+    bool ok = false;
+    try {
+      ok = writeJob(job, bytes);
+      if (!ok) std::cerr << "[ERROR] No se pudo escribir " << job.basePath << "\n";
+    } catch (const std::exception& e) {
+      std::cerr << "[ERROR] " << job.basePath << ": " << e.what() << "\n";
+    }
+    const double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - t0).count();
+    job.image.release();  // suelta el buffer antes de avisar de que terminó
+
+    std::lock_guard<std::mutex> lk(m_);
+    if (ok) {
+      ++stats_.written;
+      stats_.bytes += bytes;
+    } else {
+      ++stats_.failed;
+    }
+    stats_.encodeMs += ms;
+    if (--inFlight_ == 0) idle_.notify_all();
+  }
+}
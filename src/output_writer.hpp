@@ -0,0 +1,82 @@
+#pragma once
+#include <opencv2/core.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Formatos de salida:
+//  - PNG con nivel de compresión configurable (1 = rápido, 9 = máximo);
+//  - TIFF sin compresión;
+//  - RAW: los píxeles tal cual, sin cabecera; las dimensiones van en el
+//    nombre (<nombre>_<ancho>x<alto>x<canales>.raw).
+enum class OutputFormat { PNG, TIFF, RAW };
+
+// "png" | "tiff" | "raw"; lanza std::runtime_error con cualquier otro valor.
+OutputFormat parseOutputFormat(const std::string& name);
+const char* outputFormatExtension(OutputFormat f);
+
+struct WriterOptions {
+  OutputFormat format = OutputFormat::PNG;
+  int pngCompression = 1;   // 0-9
+  unsigned threads = 2;     // hilos de codificación/escritura
+  size_t maxQueued = 64;    // imágenes en cola antes de bloquear al productor
+};
+
+struct WriterStats {
+  std::uint64_t written = 0;
+  std::uint64_t failed = 0;
+  std::uint64_t bytes = 0;      // bytes escritos a disco
+  double encodeMs = 0;          // suma de tiempos de codificación+escritura
+  double blockedMs = 0;         // tiempo que los productores esperaron por cola llena
+  size_t peakQueued = 0;
+};
+
+// Escritor asíncrono: write() encola la imagen y vuelve; un pool propio de
+// hilos la codifica y la guarda. Con la cola llena write() bloquea
+// (backpressure), así la memoria queda acotada aunque el disco sea lento.
+// El escritor comparte el buffer de la imagen (recuento de referencias de
+// cv::Mat): el llamante no debe reescribir esos píxeles hasta que se haya
+// escrito; si reutiliza buffers, debe soltarlos antes (Mat::release).
+class OutputWriter {
+public:
+  explicit OutputWriter(const WriterOptions& opt = WriterOptions());
+  ~OutputWriter();  // vacía la cola antes de terminar
+
+  OutputWriter(const OutputWriter&) = delete;
+  OutputWriter& operator=(const OutputWriter&) = delete;
+
+  // basePath sin extensión; se añade la del formato. El directorio debe existir.
+  void write(const std::string& basePath, cv::Mat image);
+
+  // Bloquea hasta que todo lo encolado esté en disco y devuelve las estadísticas.
+  WriterStats flush();
+
+  WriterStats stats() const;
+  const WriterOptions& options() const { return opt_; }
+
+private:
+  struct Job {
+    std::string basePath;
+    cv::Mat image;
+  };
+
+  void workerLoop();
+  bool writeJob(const Job& job, std::uint64_t& bytes) const;
+
+  WriterOptions opt_;
+  std::vector<int> encodeParams_;
+
+  mutable std::mutex m_;
+  std::condition_variable notEmpty_, notFull_, idle_;
+  std::deque<Job> queue_;
+  size_t inFlight_ = 0;  // en cola + codificándose
+  bool stop_ = false;
+  WriterStats stats_;
+
+  std::vector<std::thread> workers_;
+};
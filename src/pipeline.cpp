@@ -0,0 +1,491 @@
+#include "pipeline.hpp"
+#include "itk_opencv_bridge.hpp"
+#include "windowing.hpp"
+#include "highlight.hpp"
+#include "dnn_denoising.hpp"
+#include "nlmeans.hpp"
+#include "morphology.hpp"
+#include "processing_graph.hpp"
+#include "profiler.hpp"
+#include "output_writer.hpp"
+#include "buffer_pool.hpp"
+#include "slice_source.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/photo.hpp>
+
+using namespace cv;
+namespace fs = std::filesystem;
+
+const std::array<OutputInfo, kNumOutputs> kOutputInfo = {{
+  {"1_Original",          "1. Original"},
+  {"2_Suavizada_Gaus",    "2. Suavizada Gaus"},
+  {"3_Suavizada_NLMeans", "3. Suavizada NLMeans"},
+  {"4_Suavizada_DnCNN",   "4. Suavizada DnCNN"},
+  {"5_Bordes_Canny",      "5. Bordes"},
+  {"6_TopHat",            "6. TopHat"},
+  {"7_BlackHat",          "7. BlackHat"},
+  {"8_Erosion",           "8. Erosion"},
+  {"9_Dilatacion",        "9. Dilatacion"},
+  {"10_Seg_Original",     "10. Seg. Original"},
+  {"11_Seg_Gaus",         "11. Seg. Gaus"},
+  {"12_Seg_DnCNN",        "12. Seg. DnCNN"},
+}};
+
+namespace {
+
+const char* outName(int i) { return kOutputInfo[i].fileName; }
+
+// Vecinos z-1, z+1 del slice (fuente "neighbours", solo con Fast3D)
+struct SliceNeighbours {
+  Mat prev, next;
+  RescaleParams rescale;
+};
+
+bool sameWindows(const std::vector<HUWindow>& a, const std::vector<HUWindow>& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i)
+    if (a[i].center != b[i].center || a[i].width != b[i].width) return false;
+  return true;
+}
+
+// Declara el pipeline de un slice como grafo. Los intermedios compartidos
+// (ventana del original, Gauss, HU DnCNN, etiquetas, filtros min/max) son
+// nodos propios, así que cada uno se calcula una sola vez aunque lo usen
+// varias salidas. La ventana es una fuente más: las etapas en HU (DnCNN,
+// etiquetas y NLMeans con FastHU) no dependen de ella. Los nodos de salida
+// escriben en out.images para reutilizar sus buffers entre slices. Con
+// storedInput la fuente es "stored" (SliceInput con los valores CV_16S): la
+// salida 1 se ventanea con la LUT y "hu" pasa a ser un nodo que convierte a
+// float solo si algo lo necesita (o se fija desde fuera si ya se tiene).
+void buildSliceGraph(ProcessingGraph& g, DnnDenoiser* denoiser, SliceOutputs& out, bool verbose,
+                     NLMeansEngine nlmEngine, bool storedInput) {
+  auto& img = out.images;
+  using In = ProcessingGraph::Inputs;
+  using Value = ProcessingGraph::Value;
+
+  if (storedInput) {
+    g.addSource("stored");
+    g.addNode("hu", {"stored"}, [](const In& in) -> Value {
+      const SliceInput& s = arg<SliceInput>(in, 0);
+      Mat hu = threadBufferPool().acquire(s.stored16s.size(), CV_32F);
+      convert16sToHU32f(s.stored16s, hu, s.rescale);
+      return hu;
+    });
+  } else {
+    g.addSource("hu");
+  }
+  g.addSource("window");
+  g.addSource("extra_windows");
+
+  // HU limpio de DnCNN (o el original si no hay modelo)
+  g.addNode("hu_dnn", {"hu"}, [denoiser, verbose](const In& in) -> Value {
+    const Mat& hu = arg<Mat>(in, 0);
+    if (!denoiser) return hu;
+    if (verbose) std::cout << "[PROCESO] Ejecutando DnCNN...\n";
+    return denoiser->denoiseHU(hu);
+  });
+
+  // =========================================================
+  // GRUPO A: LIMPIEZA DE IMAGEN (4 IMÁGENES)
+  // =========================================================
+
+  // 1. ORIGINAL (y sus ventanas adicionales, en la misma pasada)
+  g.addNode(outName(0), {storedInput ? "stored" : "hu", "window", "extra_windows"},
+            [&img, &out, storedInput](const In& in) -> Value {
+    Mat src;
+    RescaleParams rescale;
+    if (storedInput) {
+      src = arg<SliceInput>(in, 0).stored16s;
+      rescale = arg<SliceInput>(in, 0).rescale;
+    } else {
+      src = arg<Mat>(in, 0);
+    }
+    const HUWindow w = arg<HUWindow>(in, 1);
+    const auto& extra = arg<std::vector<HUWindow>>(in, 2);
+    if (extra.empty()) {
+      out.extraWindows.clear();
+      applyWindow(src, img[0], w, rescale);
+      return img[0];
+    }
+    // Los buffers (preparados en prepareOutputs) se reutilizan si ya tienen el tamaño
+    std::vector<HUWindow> windows{ w };
+    std::vector<Mat> dsts{ img[0] };
+    out.extraWindows.resize(extra.size());
+    for (size_t i = 0; i < extra.size(); ++i) {
+      windows.push_back(extra[i]);
+      dsts.push_back(out.extraWindows[i].image);
+    }
+    applyWindows(src, windows, dsts, rescale);
+    img[0] = dsts[0];
+    for (size_t i = 0; i < extra.size(); ++i) out.extraWindows[i] = { extra[i], dsts[i + 1] };
+    return img[0];
+  });
+
+  // 2. SUAVIZADA CON GAUSS (Clásica)
+  g.addNode(outName(1), {outName(0)}, [&img](const In& in) -> Value {
+    GaussianBlur(arg<Mat>(in, 0), img[1], Size(5, 5), 1.0);
+    return img[1];
+  });
+
+  // 3. SUAVIZADA CON NLMEANS (Avanzada Matemática). Referencia de OpenCV o,
+  // si se pide y superó la comparación con ella, el motor rápido (integral +
+  // franjas paralelas)
+  if (nlmEngine == NLMeansEngine::FastHU) {
+    // Se filtra el HU y luego se ventanea: cambiar la ventana no repite NLMeans
+    g.addNode("hu_nlm", {"hu"}, [](const In& in) -> Value {
+      const Mat& hu = arg<Mat>(in, 0);
+      NLMeansParams nlm;
+      nlm.h = kNLMeansStrengthHU;
+      Mat hu_nlm = threadBufferPool().acquire(hu.size(), CV_32F);
+      fastNlMeansCT(hu, hu_nlm, nlm);
+      return hu_nlm;
+    });
+    g.addNode(outName(2), {"hu_nlm", "window"}, [&img](const In& in) -> Value {
+      applyWindow(arg<Mat>(in, 0), img[2], arg<HUWindow>(in, 1));
+      return img[2];
+    });
+  } else {
+    std::vector<std::string> deps{ outName(0) };
+    if (nlmEngine == NLMeansEngine::Fast3D) {
+      // Los vecinos, en la misma ventana que el slice
+      g.addSource("neighbours");
+      g.addNode("neighbours_window", {"neighbours", "window"}, [](const In& in) -> Value {
+        const SliceNeighbours& n = arg<SliceNeighbours>(in, 0);
+        const HUWindow w = arg<HUWindow>(in, 1);
+        std::vector<Mat> windowed;
+        for (const Mat* s : { &n.prev, &n.next }) {
+          Mat dst;
+          if (!s->empty()) {
+            dst = threadBufferPool().acquire(s->size(), CV_8UC1);
+            applyWindow(*s, dst, w, n.rescale);
+          }
+          windowed.push_back(dst);
+        }
+        return windowed;
+      });
+      deps.push_back("neighbours_window");
+    }
+    g.addNode(outName(2), deps, [&img, verbose, nlmEngine](const In& in) -> Value {
+      const Mat& src = arg<Mat>(in, 0);
+      if (verbose) std::cout << "[PROCESO] Calculando NLMeans...\n";
+      if (nlmEngine == NLMeansEngine::OpenCV) {
+        fastNlMeansDenoising(src, img[2], 10, 7, 21);
+        return img[2];
+      }
+      NLMeansParams nlm;
+      if (verbose) {
+        nlm.progress = [](float f) {
+          if (f < 1.0f) std::cout << "[PROCESO] NLMeans " << (int)(f * 100) << "%\n";
+        };
+      }
+      if (nlmEngine != NLMeansEngine::Fast3D) {
+        fastNlMeansCT(src, img[2], nlm);
+        return img[2];
+      }
+      // En los extremos de la serie falta un vecino: se busca en los que hay
+      const auto& n = arg<std::vector<Mat>>(in, 1);
+      std::vector<Mat> slices;
+      if (!n[0].empty()) slices.push_back(n[0]);
+      const int center = (int)slices.size();
+      slices.push_back(src);
+      if (!n[1].empty()) slices.push_back(n[1]);
+      fastNlMeansCT3D(slices, center, img[2], nlm);
+      return img[2];
+    });
+  }
+
+  // 4. SUAVIZADA CON DNCNN (Deep Learning, en HU)
+  g.addNode(outName(3), {"hu_dnn", "window"}, [&img](const In& in) -> Value {
+    applyWindow(arg<Mat>(in, 0), img[3], arg<HUWindow>(in, 1));
+    return img[3];
+  });
+
+  // =========================================================
+  // GRUPO B: PROCESAMIENTO MORFOLÓGICO Y BORDES (5 IMÁGENES)
+  // =========================================================
+
+  // 5. BORDES (Canny). Gradientes Sobel del pool, como los calcula Canny internamente
+  g.addNode(outName(4), {outName(1)}, [&img](const In& in) -> Value {
+    const Mat& src = arg<Mat>(in, 0);
+    BufferPool& pool = threadBufferPool();
+    Mat dx = pool.acquire(src.size(), CV_16S), dy = pool.acquire(src.size(), CV_16S);
+    Sobel(src, dx, CV_16S, 1, 0, 3, 1, 0, BORDER_REPLICATE);
+    Sobel(src, dy, CV_16S, 0, 1, 3, 1, 0, BORDER_REPLICATE);
+    Canny(dx, dy, img[4], 50, 150);
+    return img[4];
+  });
+
+  // 6-9. TOPHAT, BLACKHAT, EROSIÓN y DILATACIÓN: los filtros min/max se
+  // calculan una sola vez y las cuatro salidas se derivan de ellos
+  g.addNode("morph", {outName(0)}, [&img](const In& in) -> Value {
+    Mat k = getStructuringElement(MORPH_RECT, Size(3, 3));
+    // Los buffers de las salidas (preparados en prepareOutputs) se pasan a
+    // morphAll, que escribe en ellos; si los sustituye, las salidas se toman de morph
+    MorphSet morph{img[7], img[8], img[5], img[6]};
+    morphAll(arg<Mat>(in, 0), k, morph);
+    img[5] = morph.tophat;
+    img[6] = morph.blackhat;
+    img[7] = morph.erode;
+    img[8] = morph.dilate;
+    return morph;
+  });
+  g.addNode(outName(5), {"morph"}, [](const In& in) -> Value { return arg<MorphSet>(in, 0).tophat; });
+  g.addNode(outName(6), {"morph"}, [](const In& in) -> Value { return arg<MorphSet>(in, 0).blackhat; });
+  g.addNode(outName(7), {"morph"}, [](const In& in) -> Value { return arg<MorphSet>(in, 0).erode; });
+  g.addNode(outName(8), {"morph"}, [](const In& in) -> Value { return arg<MorphSet>(in, 0).dilate; });
+
+  // =========================================================
+  // GRUPO C: SEGMENTACIÓN FINAL (3 IMÁGENES)
+  // =========================================================
+  auto labelsOf = [](const In& in) -> Value {
+    return generateTissueLabelsHU(arg<Mat>(in, 0));
+  };
+  auto overlayInto = [](Mat& dst) {
+    return [&dst](const In& in) -> Value {
+      renderOverlay(arg<Mat>(in, 0), arg<Mat>(in, 1), dst);
+      return dst;
+    };
+  };
+
+  // 10. SEGMENTACIÓN EN ORIGINAL
+  g.addNode("labels_raw", {"hu"}, labelsOf);
+  g.addNode(outName(9), {outName(0), "labels_raw"}, overlayInto(img[9]));
+
+  // 11. SEGMENTACIÓN EN SUAVIZADA CON GAUSS
+  g.addNode("hu_gauss", {"hu"}, [](const In& in) -> Value {
+    const Mat& hu = arg<Mat>(in, 0);
+    Mat hu_gauss = threadBufferPool().acquire(hu.size(), CV_32F);
+    GaussianBlur(hu, hu_gauss, Size(3, 3), 1.0);
+    return hu_gauss;
+  });
+  g.addNode("labels_gauss", {"hu_gauss"}, labelsOf);
+  g.addNode(outName(10), {outName(1), "labels_gauss"}, overlayInto(img[10]));
+
+  // 12. SEGMENTACIÓN EN SUAVIZADA CON DNCNN (HU limpio real, sin proxy)
+  g.addNode("labels_dnn", {"hu_dnn"}, labelsOf);
+  g.addNode(outName(11), {outName(3), "labels_dnn"}, overlayInto(img[11]));
+}
+
+std::vector<std::string> outputNames(OutputMask mask) {
+  std::vector<std::string> names;
+  for (int i = 0; i < kNumOutputs; ++i)
+    if (mask & (1u << i)) names.push_back(outName(i));
+  return names;
+}
+
+// Imágenes que se van a escribir (pedidas o intermedias): buffers del pool
+// si out no tiene ya uno de ese tamaño. Los de out se reutilizan tal cual:
+// quien pasa out es su dueño (batch lo vacía antes de reutilizarlo si el
+// escritor aún tiene sus imágenes)
+void prepareOutputs(const ProcessingGraph& g, const std::vector<std::string>& names, Size size,
+                    size_t numExtraWindows, SliceOutputs& out) {
+  BufferPool& pool = threadBufferPool();
+  for (int i = 0; i < kNumOutputs; ++i)
+    if (g.isNeeded(outName(i), names))
+      pool.ensure(out.images[i], size, i >= 9 ? CV_8UC3 : CV_8UC1);
+  if (!g.isNeeded(outName(0), names)) return;
+  out.extraWindows.resize(numExtraWindows);
+  for (auto& e : out.extraWindows) pool.ensure(e.image, size, CV_8UC1);
+}
+
+Size inputSize(const SliceInput& in) { return in.hu32f.empty() ? in.stored16s.size() : in.hu32f.size(); }
+
+// Fuentes del slice en un grafo de buildSliceGraph
+void setSliceInput(ProcessingGraph& g, const SliceInput& in, NLMeansEngine nlmEngine) {
+  if (!in.stored16s.empty()) g.setValue("stored", in);
+  if (!in.hu32f.empty()) g.setValue("hu", in.hu32f);
+  if (nlmEngine == NLMeansEngine::Fast3D)
+    g.setValue("neighbours", SliceNeighbours{ in.prevSlice, in.nextSlice, in.rescale });
+}
+
+void runSliceGraph(const SliceInput& in, const Mat* huDnn, DnnDenoiser* denoiser,
+                   SliceOutputs& out, const PipelineOptions& opt) {
+  const bool stored = !in.stored16s.empty();
+  CV_Assert(stored || !in.hu32f.empty());
+  ProcessingGraph g;
+  buildSliceGraph(g, denoiser, out, opt.verbose, opt.nlmEngine, stored);
+  setSliceInput(g, in, opt.nlmEngine);
+  g.setValue("window", opt.window);
+  g.setValue("extra_windows", opt.extraWindows);
+  // Sin DnCNN disponible (huDnn vacía), la rama 4/12 trabaja sobre el HU original
+  if (huDnn && !huDnn->empty()) g.setValue("hu_dnn", *huDnn);
+
+  const std::vector<std::string> names = outputNames(opt.outputs);
+  prepareOutputs(g, names, inputSize(in), opt.extraWindows.size(), out);
+  g.run(names, opt.pool);
+
+  // Las salidas no pedidas quedan vacías (algunas se usan como intermedio)
+  for (int i = 0; i < kNumOutputs; ++i)
+    if (!(opt.outputs & (1u << i))) out.images[i].release();
+  if (!(opt.outputs & 1u)) out.extraWindows.clear();
+}
+
+} // namespace
+
+OutputMask parseOutputList(const std::string& list) {
+  OutputMask mask = 0;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) continue;
+    int n = 0;
+    try { n = std::stoi(item); } catch (...) { n = 0; }
+    if (n < 1 || n > kNumOutputs)
+      throw std::runtime_error("Salida fuera de rango (1-" + std::to_string(kNumOutputs) + "): " + item);
+    mask |= 1u << (n - 1);
+  }
+  if (!mask) throw std::runtime_error("Lista de salidas vacía: " + list);
+  return mask;
+}
+
+bool outputsNeedDnn(OutputMask outputs) {
+  SliceOutputs dummy;
+  ProcessingGraph g;
+  buildSliceGraph(g, nullptr, dummy, false, NLMeansEngine::OpenCV, false);
+  return g.isNeeded("hu_dnn", outputNames(outputs));
+}
+
+NLMeansComparison compareNLMeansEngine(const SliceSource& source, unsigned z, NLMeansEngine e,
+                                       HUWindow w) {
+  auto windowed = [&](unsigned k) {
+    Mat win;
+    applyWindow(source.readSliceHU(k), win, w);
+    return win;
+  };
+  if (e == NLMeansEngine::Fast3D) {
+    std::vector<Mat> slices;
+    if (z > 0) slices.push_back(windowed(z - 1));
+    const int center = (int)slices.size();
+    slices.push_back(windowed(z));
+    if (z + 1 < source.numSlices()) slices.push_back(windowed(z + 1));
+    return compareWithOpenCVNLMeans(slices, center);
+  }
+  if (e != NLMeansEngine::FastHU) return compareWithOpenCVNLMeans(windowed(z));
+
+  // NLMeans sobre el HU y después la ventana, frente a la referencia sobre la ventana
+  const Mat hu = source.readSliceHU(z);
+  Mat win, huNlm, fast;
+  applyWindow(hu, win, w);
+  NLMeansComparison c;
+  TickMeter t;
+  t.start();
+  fastNlMeansDenoising(win, c.reference, 10.0f, 7, 21);
+  t.stop();
+  c.openCVMs = t.getTimeMilli();
+  NLMeansParams p;
+  p.h = kNLMeansStrengthHU;
+  t.reset();
+  t.start();
+  fastNlMeansCT(hu, huNlm, p);
+  applyWindow(huNlm, fast, w);
+  t.stop();
+  c.fastMs = t.getTimeMilli();
+  c.psnr = PSNR(c.reference, fast);
+  return c;
+}
+
+NLMeansEngine chooseNLMeansEngine(const SliceSource& source, NLMeansEngine requested, HUWindow w) {
+  if (requested == NLMeansEngine::OpenCV || source.numSlices() == 0) return NLMeansEngine::OpenCV;
+  const unsigned zc = (unsigned)source.numSlices() / 2;
+  const NLMeansComparison c = compareNLMeansEngine(source, zc, requested, w);
+  const bool accepted = c.psnr >= kNLMeansMinPSNR;
+  std::cout << "[NLM] " << nlmEngineName(requested) << ", slice " << zc << ": PSNR " << c.psnr
+            << " dB frente a OpenCV (minimo " << kNLMeansMinPSNR << " dB) | OpenCV " << c.openCVMs
+            << " ms, rapido " << c.fastMs << " ms\n";
+  if (!accepted)
+    std::cout << "[AVISO] NLMeans " << nlmEngineName(requested)
+              << " descartado: salida 3 con cv::fastNlMeansDenoising\n";
+  return accepted ? requested : NLMeansEngine::OpenCV;
+}
+
+std::string extraWindowName(HUWindow w) {
+  std::ostringstream name;
+  name << kOutputInfo[0].fileName << "_C" << w.center << "_W" << w.width;
+  return name.str();
+}
+
+void processSliceHU(const Mat& hu32f_raw, DnnDenoiser* denoiser, SliceOutputs& out,
+                    const PipelineOptions& opt) {
+  runSliceGraph(SliceInput{ hu32f_raw }, nullptr, denoiser, out, opt);
+}
+
+void processSliceHU(const Mat& hu32f_raw, const Mat& huDnn, SliceOutputs& out,
+                    const PipelineOptions& opt) {
+  runSliceGraph(SliceInput{ hu32f_raw }, &huDnn, nullptr, out, opt);
+}
+
+void processSliceHU(const SliceInput& in, const Mat& huDnn, SliceOutputs& out,
+                    const PipelineOptions& opt) {
+  runSliceGraph(in, &huDnn, nullptr, out, opt);
+}
+
+SlicePipeline::SlicePipeline(const SliceInput& in, DnnDenoiser* denoiser)
+    : in_(in), denoiser_(denoiser), size_(inputSize(in)) {
+  CV_Assert(!in.stored16s.empty() || !in.hu32f.empty());
+}
+
+SlicePipeline::~SlicePipeline() = default;
+
+void SlicePipeline::build(NLMeansEngine nlmEngine) {
+  graph_ = std::make_unique<ProcessingGraph>();
+  buildSliceGraph(*graph_, denoiser_, out_, false, nlmEngine, !in_.stored16s.empty());
+  graph_->setRetainValues(true);
+  setSliceInput(*graph_, in_, nlmEngine);
+  graph_->setValue("extra_windows", extraWindows_);
+  nlmEngine_ = nlmEngine;
+  hasWindow_ = false;
+}
+
+const SliceOutputs& SlicePipeline::run(const PipelineOptions& opt) {
+  if (!graph_ || nlmEngine_ != opt.nlmEngine) build(opt.nlmEngine);
+
+  const bool windowChanged = !hasWindow_ || window_.center != opt.window.center ||
+                             window_.width != opt.window.width;
+  if (windowChanged) {
+    graph_->setValue("window", opt.window);
+    graph_->invalidateDependents("window");
+    window_ = opt.window;
+    hasWindow_ = true;
+  }
+  if (!sameWindows(extraWindows_, opt.extraWindows)) {
+    graph_->setValue("extra_windows", opt.extraWindows);
+    graph_->invalidateDependents("extra_windows");
+    extraWindows_ = opt.extraWindows;
+  }
+
+  const std::vector<std::string> names = outputNames(opt.outputs);
+  prepareOutputs(*graph_, names, size_, extraWindows_.size(), out_);
+  graph_->run(names, opt.pool);
+  return out_;
+}
+
+void saveSliceOutputs(const SliceOutputs& out, const std::string& outDir) {
+  fs::create_directories(outDir);
+  for (int i = 0; i < kNumOutputs; ++i) {
+    if (out.images[i].empty()) continue;  // salida no seleccionada
+    PROFILE_SCOPE("png_encode");
+    imwrite((fs::path(outDir) / (std::string(kOutputInfo[i].fileName) + ".png")).string(),
+            out.images[i]);
+  }
+  for (const WindowedImage& e : out.extraWindows) {
+    PROFILE_SCOPE("png_encode");
+    imwrite((fs::path(outDir) / (extraWindowName(e.window) + ".png")).string(), e.image);
+  }
+}
+
+void saveSliceOutputs(const SliceOutputs& out, const std::string& outDir, OutputWriter& writer) {
+  fs::create_directories(outDir);
+  for (int i = 0; i < kNumOutputs; ++i) {
+    if (out.images[i].empty()) continue;
+    writer.write((fs::path(outDir) / kOutputInfo[i].fileName).string(), out.images[i]);
+  }
+  for (const WindowedImage& e : out.extraWindows)
+    writer.write((fs::path(outDir) / extraWindowName(e.window)).string(), e.image);
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include "windowing.hpp"  // HUWindow
+#include "nlmeans.hpp"    // NLMeansEngine
+#include <opencv2/core.hpp>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class DnnDenoiser;
+class ThreadPool;
+class OutputWriter;
+class ProcessingGraph;
+class SliceSource;
+
+// Las 12 evidencias que se generan por cada slice.
+constexpr int kNumOutputs = 12;
+
+struct OutputInfo {
+  const char* fileName;     // nombre del PNG (sin extensión)
+  const char* windowTitle;  // título de la ventana de imshow
+};
+
+extern const std::array<OutputInfo, kNumOutputs> kOutputInfo;
+
+// Salida 1 en una ventana adicional (PipelineOptions::extraWindows).
+struct WindowedImage {
+  HUWindow window;
+  cv::Mat image;
+};
+
+struct SliceOutputs {
+  std::array<cv::Mat, kNumOutputs> images;
+  std::vector<WindowedImage> extraWindows;  // vacío si no se piden o no se pide la salida 1
+};
+
+// Nombre de archivo de la salida 1 en otra ventana: "1_Original_C400_W1800".
+std::string extraWindowName(HUWindow w);
+
+// Slice de entrada. hu32f es el HU (CV_32F); stored16s, opcional, son los
+// valores almacenados CV_16S con su reescalado (SliceSource::storedSlice16s,
+// p.ej. la vista sin copia de un .huv). Con stored16s la salida 1 y sus
+// ventanas salen de la LUT de 64K, y si hu32f está vacío el HU float solo se
+// calcula si alguna salida pedida lo necesita. prevSlice/nextSlice (z-1, z+1)
+// solo los usa NLMeansEngine::Fast3D; van en la misma representación que el
+// slice (CV_16S con el mismo reescalado si hay stored16s, si no HU CV_32F) y
+// pueden faltar en los extremos de la serie.
+struct SliceInput {
+  cv::Mat hu32f;
+  cv::Mat stored16s;
+  RescaleParams rescale;
+  cv::Mat prevSlice, nextSlice;
+};
+
+// Salidas seleccionadas: bit i => kOutputInfo[i].
+using OutputMask = std::uint32_t;
+constexpr OutputMask kAllOutputs = (1u << kNumOutputs) - 1;
+
+// "1,4,12" (numeración de los PNG, desde 1) -> máscara. Lanza std::runtime_error
+// si algún número está fuera de rango.
+OutputMask parseOutputList(const std::string& list);
+
+// ¿Alguna de las salidas pedidas depende de DnCNN (4 y 12)?
+bool outputsNeedDnn(OutputMask outputs);
+
+struct PipelineOptions {
+  bool verbose = false;
+  OutputMask outputs = kAllOutputs;
+  // Con pool, las etapas independientes (NLMeans, DnCNN, segmentaciones...)
+  // corren en paralelo. No pasar el pool del worker que llama.
+  ThreadPool* pool = nullptr;
+  // Ventana de las salidas de 8 bits; las etapas en HU no dependen de ella
+  HUWindow window = kWindowSoftTissue;
+  // Ventanas adicionales de la salida 1 (p.ej. hueso y pulmón): se calculan en
+  // la misma pasada que la principal (applyWindows) y van a out.extraWindows
+  std::vector<HUWindow> extraWindows;
+  // Motor de la salida 3. Los rápidos solo si superan kNLMeansMinPSNR frente
+  // a la referencia (chooseNLMeansEngine); Fast3D necesita los vecinos de SliceInput.
+  NLMeansEngine nlmEngine = NLMeansEngine::OpenCV;
+};
+
+// PSNR y tiempos del motor e frente a cv::fastNlMeansDenoising(10, 7, 21) en el
+// slice z de source, ventaneado con w (Fast3D toma también z-1 y z+1).
+NLMeansComparison compareNLMeansEngine(const SliceSource& source, unsigned z, NLMeansEngine e,
+                                       HUWindow w = kWindowSoftTissue);
+
+// Motor de la salida 3 para la serie: requested si en su slice central supera
+// kNLMeansMinPSNR (lo informa con [NLM]), si no la referencia de OpenCV.
+NLMeansEngine chooseNLMeansEngine(const SliceSource& source, NLMeansEngine requested,
+                                  HUWindow w = kWindowSoftTissue);
+
+// Ejecuta el pipeline (grupos A, B y C) sobre un slice en HU (CV_32F) como un
+// grafo de etapas: solo se calculan las etapas que necesitan las salidas
+// pedidas, y cada intermedio compartido una sola vez. Las salidas no pedidas
+// quedan vacías. denoiser puede ser nullptr: en ese caso la salida DnCNN es
+// una copia del original. Las imágenes de out se reutilizan si ya tienen el
+// tamaño correcto, así que conviene mantener un SliceOutputs por hilo.
+void processSliceHU(const cv::Mat& hu32f, DnnDenoiser* denoiser, SliceOutputs& out,
+                    const PipelineOptions& opt = {});
+
+// Variante con el HU limpio de DnCNN ya calculado (CV_32F), p.ej. por lotes con
+// DnnDenoiser::denoiseBatchHU. Si huDnn está vacía se usa el HU original.
+void processSliceHU(const cv::Mat& hu32f, const cv::Mat& huDnn, SliceOutputs& out,
+                    const PipelineOptions& opt = {});
+
+// Igual, con los valores almacenados del slice si el origen los tiene (ver
+// SliceInput). Si huDnn está vacía la rama DnCNN usa el HU original.
+void processSliceHU(const SliceInput& in, const cv::Mat& huDnn, SliceOutputs& out,
+                    const PipelineOptions& opt = {});
+
+// Pipeline incremental de un slice: conserva los intermedios entre
+// ejecuciones, así que run() solo calcula lo que falta. Con otra ventana se
+// recalculan únicamente las etapas que dependen de ella (ventaneo, Gauss,
+// Canny, morfología y superposiciones); DnCNN y las etiquetas de tejido, que
+// trabajan en HU, se reutilizan.
+//
+// La salida 3 usa el motor de PipelineOptions::nlmEngine. Con FastHU
+// (fastNlMeansCT sobre el HU, h = kNLMeansStrengthHU) NLMeans tampoco se
+// repite al cambiar de ventana; con los demás motores sí, porque filtran la
+// imagen ya ventaneada. Elegir el motor con chooseNLMeansEngine (puerta de
+// PSNR frente a la referencia de OpenCV). Si cambia entre ejecuciones, el
+// grafo se reconstruye y se recalcula todo.
+//
+// El denoiser solo se usa la primera vez que se pide una salida DnCNN.
+// No es seguro entre hilos.
+class SlicePipeline {
+public:
+  SlicePipeline(const SliceInput& in, DnnDenoiser* denoiser);
+  ~SlicePipeline();
+
+  SlicePipeline(const SlicePipeline&) = delete;
+  SlicePipeline& operator=(const SlicePipeline&) = delete;
+
+  const SliceOutputs& run(const PipelineOptions& opt = {});
+  const SliceOutputs& outputs() const { return out_; }
+  // Ventana de la última ejecución
+  HUWindow window() const { return window_; }
+
+private:
+  void build(NLMeansEngine nlmEngine);
+
+  SliceInput in_;
+  DnnDenoiser* denoiser_;
+  std::unique_ptr<ProcessingGraph> graph_;  // se construye en el primer run()
+  NLMeansEngine nlmEngine_ = NLMeansEngine::OpenCV;
+  SliceOutputs out_;  // los nodos de salida escriben aquí
+  cv::Size size_;
+  HUWindow window_ = kWindowSoftTissue;
+  std::vector<HUWindow> extraWindows_;
+  bool hasWindow_ = false;
+};
+
+// Guarda en outDir (se crea si no existe) las imágenes no vacías de out.
+void saveSliceOutputs(const SliceOutputs& out, const std::string& outDir);
+
+// Igual, pero encolando en un escritor asíncrono con su formato. Los buffers
+// quedan compartidos con el escritor: si out se reutiliza para el siguiente
+// slice hay que soltar antes sus imágenes (out = SliceOutputs()).
+void saveSliceOutputs(const SliceOutputs& out, const std::string& outDir, OutputWriter& writer);
@@ -1,4 +1,5 @@
 #include "processing.hpp"
+#include "morphology.hpp"
 #include <algorithm>
 
 using namespace cv;
@@ -7,7 +8,7 @@ static Mat toGray8(const Mat& in) {
   CV_Assert(!in.empty());
   Mat g;
   if (in.channels() == 3) cvtColor(in, g, COLOR_BGR2GRAY);
-  else g = in.clone();
+  else g = in;  // sin copia: los llamadores no escriben sobre g
 
   if (g.depth() != CV_8U) {
     double minv, maxv; minMaxLoc(g, &minv, &maxv);
@@ -33,9 +34,10 @@ cv::Mat denoiseClassic(const cv::Mat& g) {
 
 cv::Mat edgesCanny(const cv::Mat& g, double lo, double hi) {
   Mat gray = toGray8(g);
-  GaussianBlur(gray, gray, Size(3,3), 0.8);
+  Mat blurred;
+  GaussianBlur(gray, blurred, Size(3,3), 0.8);
   Mat edges;
-  Canny(gray, edges, lo, hi, 3, true);
+  Canny(blurred, edges, lo, hi, 3, true);
   return edges;
 }
 
@@ -45,15 +47,15 @@ static Mat kernelEllipse(int k) {
 }
 
 cv::Mat morphOpen(const cv::Mat& g, int k) {
-  Mat bin = toGray8(g);
-  threshold(bin, bin, 0, 255, THRESH_BINARY | THRESH_OTSU);
-  Mat out; morphologyEx(bin, out, MORPH_OPEN, kernelEllipse(k));
+  Mat bin;
+  threshold(toGray8(g), bin, 0, 255, THRESH_BINARY | THRESH_OTSU);
+  Mat out; morphOpenFast(bin, out, kernelEllipse(k));
   return out;
 }
 
 cv::Mat morphClose(const cv::Mat& g, int k) {
-  Mat bin = toGray8(g);
-  threshold(bin, bin, 0, 255, THRESH_BINARY | THRESH_OTSU);
-  Mat out; morphologyEx(bin, out, MORPH_CLOSE, kernelEllipse(k));
+  Mat bin;
+  threshold(toGray8(g), bin, 0, 255, THRESH_BINARY | THRESH_OTSU);
+  Mat out; morphCloseFast(bin, out, kernelEllipse(k));
   return out;
 }
\ No newline at end of file
@@ -6,6 +6,7 @@ cv::Mat equalize(const cv::Mat& g);
 cv::Mat denoiseClassic(const cv::Mat& g);
 cv::Mat edgesCanny(const cv::Mat& g, double lo = 40, double hi = 120);
 
-// Morfología
+// Morfología (motor de morphology.hpp: elipse descompuesta en segmentos,
+// van Herk/Gil-Werman para kernels grandes)
 cv::Mat morphOpen(const cv::Mat& g, int k = 3);
 cv::Mat morphClose(const cv::Mat& g, int k = 3);
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "processing_graph.hpp"
+#include "thread_pool.hpp"
+#include "profiler.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+
+int ProcessingGraph::id(const std::string& name) const {
+  auto it = index_.find(name);
+  if (it == index_.end()) throw std::runtime_error("Nodo desconocido en el grafo: " + name);
+  return it->second;
+}
+
+void ProcessingGraph::addSource(const std::string& name) {
+  addNode(name, {}, nullptr);
+}
+
+void ProcessingGraph::addNode(const std::string& name, const std::vector<std::string>& deps, NodeFn fn) {
+  if (hasNode(name)) throw std::runtime_error("Nodo duplicado en el grafo: " + name);
+  Node n;
+  n.name = name;
+  n.fn = std::move(fn);
+  for (const auto& d : deps) n.deps.push_back(id(d));
+  index_[name] = (int)nodes_.size();
+  nodes_.push_back(std::move(n));
+}
+
+void ProcessingGraph::setValue(const std::string& name, Value v) {
+  Node& n = nodes_[id(name)];
+  n.value = std::move(v);
+  n.hasValue = true;
+}
+
+void ProcessingGraph::clearValues() {
+  for (auto& n : nodes_) {
+    n.value.reset();
+    n.hasValue = false;
+  }
+}
+
+void ProcessingGraph::invalidateDependents(const std::string& name) {
+  // El orden de inserción es topológico: basta una pasada hacia delante
+  std::vector<bool> dirty(nodes_.size(), false);
+  dirty[id(name)] = true;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    for (int d : nodes_[i].deps) {
+      if (!dirty[d]) continue;
+      dirty[i] = true;
+      nodes_[i].value.reset();
+      nodes_[i].hasValue = false;
+      break;
+    }
+  }
+}
+
+std::vector<bool> ProcessingGraph::neededToCompute(const std::vector<std::string>& outputs) const {
+  std::vector<bool> needed(nodes_.size(), false);
+  std::vector<int> stack;
+  for (const auto& o : outputs) stack.push_back(id(o));
+  while (!stack.empty()) {
+    const int i = stack.back();
+    stack.pop_back();
+    if (needed[i] || nodes_[i].hasValue) continue;  // los valores ya fijados cortan la búsqueda
+    if (!nodes_[i].fn) throw std::runtime_error("Fuente sin valor en el grafo: " + nodes_[i].name);
+    needed[i] = true;
+    for (int d : nodes_[i].deps) stack.push_back(d);
+  }
+  return needed;
+}
+
+bool ProcessingGraph::isNeeded(const std::string& node, const std::vector<std::string>& outputs) const {
+  const int i = id(node);
+  if (nodes_[i].hasValue) return false;
+  // Las fuentes sin valor no se pueden calcular: basta con ver si algún camino llega a ellas
+  std::vector<bool> seen(nodes_.size(), false);
+  std::vector<int> stack;
+  for (const auto& o : outputs) stack.push_back(id(o));
+  while (!stack.empty()) {
+    const int k = stack.back();
+    stack.pop_back();
+    if (seen[k] || nodes_[k].hasValue) continue;
+    if (k == i) return true;
+    seen[k] = true;
+    for (int d : nodes_[k].deps) stack.push_back(d);
+  }
+  return false;
+}
+
+std::map<std::string, ProcessingGraph::Value>
+ProcessingGraph::run(const std::vector<std::string>& outputs, ThreadPool* pool) {
+  const std::vector<bool> needed = neededToCompute(outputs);
+  const size_t N = nodes_.size();
+
+  std::vector<bool> isOutput(N, false);
+  for (const auto& o : outputs) isOutput[id(o)] = true;
+
+  // Dependencias pendientes de cada nodo y consumidores restantes de cada valor
+  std::vector<int> pendingDeps(N, 0), remainingConsumers(N, 0);
+  std::vector<std::vector<int>> consumers(N);
+  for (size_t i = 0; i < N; ++i) {
+    if (!needed[i]) continue;
+    for (int d : nodes_[i].deps) {
+      consumers[d].push_back((int)i);
+      ++remainingConsumers[d];
+      if (needed[d]) ++pendingDeps[i];
+    }
+  }
+
+  auto compute = [this](int i) {
+    ScopedStage stage(nodes_[i].name);  // cada nodo es una etapa del perfil
+    Inputs inputs;
+    inputs.reserve(nodes_[i].deps.size());
+    for (int d : nodes_[i].deps) inputs.push_back(&nodes_[d].value);
+    return nodes_[i].fn(inputs);
+  };
+
+  // Libera un intermedio calculado en esta ejecución cuando ya nadie lo necesita
+  auto release = [&](int d) {
+    if (--remainingConsumers[d] == 0 && needed[d] && !isOutput[d] && !retain_) {
+      nodes_[d].value.reset();
+      nodes_[d].hasValue = false;
+    }
+  };
+
+  if (!pool) {
+    for (size_t i = 0; i < N; ++i) {
+      if (!needed[i]) continue;
+      nodes_[i].value = compute((int)i);
+      nodes_[i].hasValue = true;
+      for (int d : nodes_[i].deps) release(d);
+    }
+  } else {
+    std::mutex m;
+    std::condition_variable cv;
+    size_t inFlight = 0;  // nodos enviados al pool que aún no han terminado
+    std::exception_ptr error;
+
+    std::function<void(int)> launch = [&](int i) {
+      pool->submit([&, i] {
+        Value v;
+        bool ok = false;
+        try {
+          v = compute(i);
+          ok = true;
+        } catch (...) {
+          std::lock_guard<std::mutex> lk(m);
+          if (!error) error = std::current_exception();
+        }
+
+        std::vector<int> ready;
+        {
+          std::lock_guard<std::mutex> lk(m);
+          if (ok) {
+            nodes_[i].value = std::move(v);
+            nodes_[i].hasValue = true;
+          }
+          for (int d : nodes_[i].deps) release(d);
+          for (int c : consumers[i]) {
+            if (!needed[c]) continue;
+            if (--pendingDeps[c] == 0) ready.push_back(c);
+          }
+          // Tras un error no se lanza nada nuevo: basta con drenar lo que ya corre
+          if (error) ready.clear();
+          inFlight += ready.size();
+          --inFlight;
+          // Se notifica con el mutex tomado: en cuanto inFlight llega a 0 el
+          // hilo que espera puede salir de run() y destruir m y cv
+          cv.notify_all();
+        }
+        for (int c : ready) launch(c);
+      });
+    };
+
+    std::vector<int> initial;
+    for (size_t i = 0; i < N; ++i)
+      if (needed[i] && pendingDeps[i] == 0) initial.push_back((int)i);
+    {
+      std::lock_guard<std::mutex> lk(m);
+      inFlight = initial.size();
+    }
+    for (int i : initial) launch(i);
+
+    std::unique_lock<std::mutex> lk(m);
+    cv.wait(lk, [&] { return inFlight == 0; });
+    if (error) std::rethrow_exception(error);
+  }
+
+  std::map<std::string, Value> result;
+  for (const auto& o : outputs) result[o] = nodes_[id(o)].value;
+  return result;
+}
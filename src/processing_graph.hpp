@@ -0,0 +1,71 @@
+#pragma once
+#include <any>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+// Grafo de procesamiento declarativo (DAG). Cada nodo declara sus
+// dependencias por nombre y una función que produce su valor a partir de los
+// valores de esas dependencias. run() ejecuta solo los nodos necesarios para
+// las salidas pedidas, calcula cada intermedio compartido una sola vez, lanza
+// en paralelo los nodos independientes y libera cada valor intermedio en
+// cuanto su último consumidor termina.
+class ProcessingGraph {
+public:
+  using Value = std::any;
+  using Inputs = std::vector<const Value*>;  // en el orden de deps
+  using NodeFn = std::function<Value(const Inputs&)>;
+
+  // Valor que se fija desde fuera (p.ej. el slice en HU).
+  void addSource(const std::string& name);
+  // Las dependencias deben existir ya: el orden de inserción es topológico.
+  void addNode(const std::string& name, const std::vector<std::string>& deps, NodeFn fn);
+
+  bool hasNode(const std::string& name) const { return index_.count(name) > 0; }
+
+  // Fija el valor de una fuente o de un nodo precalculado (no se recalcula).
+  void setValue(const std::string& name, Value v);
+  // Borra todos los valores (fuentes incluidas), p.ej. antes del siguiente slice.
+  void clearValues();
+  // Borra los valores de todos los nodos que dependen (directa o
+  // indirectamente) de `name`, p.ej. tras cambiar el valor de una fuente.
+  void invalidateDependents(const std::string& name);
+
+  // Con retain, run() conserva los intermedios en lugar de liberarlos tras su
+  // último consumidor: las ejecuciones siguientes solo recalculan lo invalidado.
+  void setRetainValues(bool retain) { retain_ = retain; }
+
+  // ¿Hay que calcular `node` para producir `outputs` con los valores actuales?
+  bool isNeeded(const std::string& node, const std::vector<std::string>& outputs) const;
+
+  // Ejecuta el grafo. Con pool, los nodos listos se envían al pool y el hilo
+  // que llama espera (no llamar desde un worker del mismo pool). Sin pool, se
+  // ejecuta en orden topológico en el hilo actual. Relanza la primera excepción.
+  std::map<std::string, Value> run(const std::vector<std::string>& outputs, ThreadPool* pool = nullptr);
+
+private:
+  struct Node {
+    std::string name;
+    std::vector<int> deps;
+    NodeFn fn;          // vacío en las fuentes
+    Value value;
+    bool hasValue = false;
+  };
+
+  int id(const std::string& name) const;
+  std::vector<bool> neededToCompute(const std::vector<std::string>& outputs) const;
+
+  std::vector<Node> nodes_;
+  std::unordered_map<std::string, int> index_;
+  bool retain_ = false;
+};
+
+// Acceso cómodo al valor de una dependencia: arg<cv::Mat>(inputs, 0)
+template <class T>
+const T& arg(const ProcessingGraph::Inputs& inputs, size_t i) {
+  return std::any_cast<const T&>(*inputs[i]);
+}
@@ -0,0 +1,257 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <opencv2/core.hpp>
+
+namespace {
+
+thread_local std::uint64_t tlsAllocBytes = 0;
+thread_local std::uint64_t tlsAllocCount = 0;
+
+int threadId() {
+  static std::atomic<int> next{0};
+  thread_local int id = next.fetch_add(1);
+  return id;
+}
+
+// Envuelve el asignador por defecto de cv::Mat y cuenta las reservas del hilo.
+// Los UMatData que crea el asignador base apuntan a él mismo, así que las
+// liberaciones no pasan por aquí y se puede retirar en cualquier momento.
+class CountingAllocator : public cv::MatAllocator {
+public:
+  explicit CountingAllocator(cv::MatAllocator* base) : base_(base) {}
+
+  cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                         cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+    cv::UMatData* u = base_->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+    if (u && !data0) {
+      tlsAllocBytes += u->size;
+      ++tlsAllocCount;
+    }
+    return u;
+  }
+
+  bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags,
+                cv::UMatUsageFlags usageFlags) const override {
+    return base_->allocate(data, accessFlags, usageFlags);
+  }
+
+  void deallocate(cv::UMatData* data) const override { base_->deallocate(data); }
+
+private:
+  cv::MatAllocator* base_;
+};
+
+std::uint64_t readStatusKb(const char* key) {
+  std::ifstream f("/proc/self/status");
+  std::string line;
+  const size_t len = std::char_traits<char>::length(key);
+  while (std::getline(f, line)) {
+    if (line.compare(0, len, key) == 0) return std::stoull(line.substr(len)) * 1024;
+  }
+  return 0;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  // Rango más cercano
+  const size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+  return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+std::string jsonEscape(const std::string& s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += c;
+  }
+  return out;
+}
+
+// Campo CSV (RFC 4180): entre comillas, con las comillas internas duplicadas,
+// así una etapa con comas o saltos de línea no rompe las columnas
+std::string csvField(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"') out += '"';
+    out += c;
+  }
+  return out + '"';
+}
+
+} // namespace
+
+Profiler& Profiler::instance() {
+  static Profiler p;
+  return p;
+}
+
+Profiler::Profiler() : epoch_(std::chrono::steady_clock::now()) {}
+
+void Profiler::setAllocationCounting(bool on) {
+  static cv::MatAllocator* base = cv::Mat::getDefaultAllocator();
+  static CountingAllocator counting(base);
+  cv::Mat::setDefaultAllocator(on ? &counting : base);
+}
+
+void Profiler::setEnabled(bool on) {
+  setAllocationCounting(on);
+  enabled_ = on;
+}
+
+void Profiler::reset() {
+  std::lock_guard<std::mutex> lk(m_);
+  names_.clear();
+  ids_.clear();
+  stages_.clear();
+  events_.clear();
+}
+
+std::int64_t Profiler::nowUs() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - epoch_).count();
+}
+
+std::uint64_t Profiler::threadAllocatedBytes() { return tlsAllocBytes; }
+std::uint64_t Profiler::threadAllocations() { return tlsAllocCount; }
+
+std::uint64_t Profiler::peakRssBytes() { return readStatusKb("VmHWM:"); }
+std::uint64_t Profiler::currentRssBytes() { return readStatusKb("VmRSS:"); }
+
+void Profiler::record(const std::string& stage, std::int64_t startUs, std::int64_t durUs,
+                      std::uint64_t bytes, std::uint64_t allocs) {
+  const int tid = threadId();
+
+  std::lock_guard<std::mutex> lk(m_);
+  auto it = ids_.find(stage);
+  int id;
+  if (it == ids_.end()) {
+    id = (int)names_.size();
+    ids_.emplace(stage, id);
+    names_.push_back(stage);
+    stages_.emplace_back();
+  } else {
+    id = it->second;
+  }
+
+  Stage& s = stages_[id];
+  s.durationsMs.push_back(durUs / 1000.0);
+  s.bytes += bytes;
+  s.allocs += allocs;
+  if (trace_) events_.push_back({id, startUs, durUs, tid});
+}
+
+std::vector<Profiler::StageStats> Profiler::stats() const {
+  std::lock_guard<std::mutex> lk(m_);
+  std::vector<StageStats> out;
+  out.reserve(stages_.size());
+  for (size_t i = 0; i < stages_.size(); ++i) {
+    const Stage& s = stages_[i];
+    std::vector<double> d = s.durationsMs;
+    std::sort(d.begin(), d.end());
+
+    StageStats st;
+    st.name = names_[i];
+    st.count = d.size();
+    for (double v : d) st.totalMs += v;
+    st.meanMs = d.empty() ? 0.0 : st.totalMs / d.size();
+    st.p50Ms = percentile(d, 50);
+    st.p95Ms = percentile(d, 95);
+    st.p99Ms = percentile(d, 99);
+    st.maxMs = d.empty() ? 0.0 : d.back();
+    st.bytesAllocated = s.bytes;
+    st.allocations = s.allocs;
+    out.push_back(std::move(st));
+  }
+  // Las etapas más caras primero
+  std::sort(out.begin(), out.end(),
+            [](const StageStats& a, const StageStats& b) { return a.totalMs > b.totalMs; });
+  return out;
+}
+
+void Profiler::printSummary(std::ostream& os) const {
+  const auto st = stats();
+  os << "\n[PERFIL] " << std::left << std::setw(22) << "Etapa" << std::right
+     << std::setw(7) << "n" << std::setw(11) << "total ms" << std::setw(9) << "p50"
+     << std::setw(9) << "p95" << std::setw(9) << "p99" << std::setw(11) << "MB reserv." << "\n";
+  os << std::fixed << std::setprecision(2);
+  for (const auto& s : st) {
+    os << "[PERFIL] " << std::left << std::setw(22) << s.name << std::right
+       << std::setw(7) << s.count << std::setw(11) << s.totalMs << std::setw(9) << s.p50Ms
+       << std::setw(9) << s.p95Ms << std::setw(9) << s.p99Ms
+       << std::setw(11) << s.bytesAllocated / (1024.0 * 1024.0) << "\n";
+  }
+  os << "[PERFIL] Pico de RSS del proceso: " << peakRssBytes() / (1024.0 * 1024.0) << " MB\n";
+  os << std::defaultfloat;
+}
+
+bool Profiler::writeJson(const std::string& path) const {
+  std::ofstream f(path);
+  if (!f) return false;
+  const auto st = stats();
+  f << "{\n  \"process_peak_rss_bytes\": " << peakRssBytes() << ",\n  \"stages\": [\n";
+  for (size_t i = 0; i < st.size(); ++i) {
+    const auto& s = st[i];
+    f << "    {\"name\": \"" << jsonEscape(s.name) << "\", \"count\": " << s.count
+      << ", \"total_ms\": " << s.totalMs << ", \"mean_ms\": " << s.meanMs
+      << ", \"p50_ms\": " << s.p50Ms << ", \"p95_ms\": " << s.p95Ms
+      << ", \"p99_ms\": " << s.p99Ms << ", \"max_ms\": " << s.maxMs
+      << ", \"bytes_allocated\": " << s.bytesAllocated << ", \"allocations\": " << s.allocations
+      << "}" << (i + 1 < st.size() ? "," : "") << "\n";
+  }
+  f << "  ]\n}\n";
+  return (bool)f;
+}
+
+bool Profiler::writeCsv(const std::string& path) const {
+  std::ofstream f(path);
+  if (!f) return false;
+  f << "stage,count,total_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,bytes_allocated,allocations\n";
+  for (const auto& s : stats()) {
+    f << csvField(s.name) << "," << s.count << "," << s.totalMs << "," << s.meanMs << "," << s.p50Ms << ","
+      << s.p95Ms << "," << s.p99Ms << "," << s.maxMs << "," << s.bytesAllocated << ","
+      << s.allocations << "\n";
+  }
+  return (bool)f;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) const {
+  std::ofstream f(path);
+  if (!f) return false;
+  std::lock_guard<std::mutex> lk(m_);
+  // Formato "Trace Event": eventos completos (ph = X) con tiempos en µs
+  f << "{\"traceEvents\": [\n";
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const auto& e = events_[i];
+    f << "  {\"name\": \"" << jsonEscape(names_[e.stage]) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+      << e.tid << ", \"ts\": " << e.startUs << ", \"dur\": " << e.durUs << "}"
+      << (i + 1 < events_.size() ? "," : "") << "\n";
+  }
+  f << "], \"displayTimeUnit\": \"ms\"}\n";
+  return (bool)f;
+}
+
+ScopedStage::ScopedStage(const char* stage) : active_(Profiler::instance().enabled()) {
+  if (active_) start(stage);
+}
+
+ScopedStage::ScopedStage(const std::string& stage) : active_(Profiler::instance().enabled()) {
+  if (active_) start(stage);
+}
+
+void ScopedStage::start(const std::string& stage) {
+  stage_ = stage;
+  bytes0_ = Profiler::threadAllocatedBytes();
+  allocs0_ = Profiler::threadAllocations();
+  startUs_ = Profiler::instance().nowUs();
+}
+
+ScopedStage::~ScopedStage() {
+  if (!active_) return;
+  Profiler& p = Profiler::instance();
+  p.record(stage_, startUs_, p.nowUs() - startUs_,
+           Profiler::threadAllocatedBytes() - bytes0_, Profiler::threadAllocations() - allocs0_);
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Instrumentación por etapa: tiempo y bytes reservados en cv::Mat.
+// Desactivado no cuesta más que una lectura atómica por ámbito. Activado:
+//  - cada ámbito PROFILE_SCOPE("etapa") registra su duración;
+//  - los bytes reservados se cuentan con un cv::MatAllocator envoltorio
+//    (solo las reservas hechas en el hilo del ámbito, no las internas de los
+//    workers de parallel_for_);
+//  - el pico de RSS (VmHWM de /proc/self/status) es del proceso, no de una
+//    etapa: se lee una vez por informe, no en cada ámbito.
+// Los informes agregan por etapa count/total/media/p50/p95/p99/max en JSON o
+// CSV, y opcionalmente una traza para chrome://tracing / Perfetto.
+class Profiler {
+public:
+  struct StageStats {
+    std::string name;
+    size_t count = 0;
+    double totalMs = 0, meanMs = 0, p50Ms = 0, p95Ms = 0, p99Ms = 0, maxMs = 0;
+    std::uint64_t bytesAllocated = 0;  // suma de todas las ejecuciones
+    std::uint64_t allocations = 0;
+  };
+
+  static Profiler& instance();
+
+  // Activa/desactiva el registro e instala (o retira) el asignador contador.
+  void setEnabled(bool on);
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  // Guarda además cada ejecución individual para la traza de Chrome.
+  void setTraceEnabled(bool on) { trace_ = on; }
+
+  void reset();
+
+  // Llamado por ScopedStage al cerrar un ámbito.
+  void record(const std::string& stage, std::int64_t startUs, std::int64_t durUs,
+              std::uint64_t bytes, std::uint64_t allocs);
+
+  std::vector<StageStats> stats() const;
+
+  void printSummary(std::ostream& os) const;
+  // Devuelven false si no se pudo escribir el fichero.
+  bool writeJson(const std::string& path) const;
+  bool writeCsv(const std::string& path) const;
+  bool writeChromeTrace(const std::string& path) const;
+
+  // Microsegundos desde la creación del perfilador.
+  std::int64_t nowUs() const;
+
+  // Instala solo el asignador contador, sin registrar etapas (benchmarks).
+  static void setAllocationCounting(bool on);
+  // Contadores del asignador para el hilo actual (monótonos).
+  static std::uint64_t threadAllocatedBytes();
+  static std::uint64_t threadAllocations();
+
+  static std::uint64_t peakRssBytes();
+  static std::uint64_t currentRssBytes();
+
+private:
+  Profiler();
+
+  struct Stage {
+    std::vector<double> durationsMs;
+    std::uint64_t bytes = 0, allocs = 0;
+  };
+  struct TraceEvent {
+    int stage;
+    std::int64_t startUs, durUs;
+    int tid;
+  };
+
+  std::atomic<bool> enabled_{false};
+  bool trace_ = false;
+  const std::chrono::steady_clock::time_point epoch_;
+
+  mutable std::mutex m_;
+  std::vector<std::string> names_;
+  std::unordered_map<std::string, int> ids_;
+  std::vector<Stage> stages_;
+  std::vector<TraceEvent> events_;
+};
+
+// Ámbito medido. El nombre se copia, así que puede ser temporal.
+class ScopedStage {
+public:
+  explicit ScopedStage(const char* stage);
+  explicit ScopedStage(const std::string& stage);
+  ~ScopedStage();
+
+  ScopedStage(const ScopedStage&) = delete;
+  ScopedStage& operator=(const ScopedStage&) = delete;
+
+private:
+  void start(const std::string& stage);
+
+  bool active_;
+  std::string stage_;
+  std::int64_t startUs_ = 0;
+  std::uint64_t bytes0_ = 0, allocs0_ = 0;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage) ScopedStage PROFILE_CONCAT(profileScope_, __LINE__)(stage)
@@ -0,0 +1,184 @@
+#include "series_cache.hpp"
+#include "hu_volume.hpp"
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+using namespace cv;
+namespace fs = std::filesystem;
+
+// Origen que sirve los slices desde la caché. La caché debe sobrevivirle
+// (globalSeriesCache es estática).
+class CachedSliceSource : public SliceSource {
+public:
+  CachedSliceSource(SeriesCache& cache, std::shared_ptr<SeriesCache::Entry> entry)
+      : cache_(cache), entry_(std::move(entry)) {}
+
+  size_t numSlices() const override { return entry_->source->numSlices(); }
+  Size sliceSize() const override { return entry_->source->sliceSize(); }
+  Vec3d spacing() const override { return entry_->source->spacing(); }
+  std::string seriesUID() const override { return entry_->source->seriesUID(); }
+  int indexOf(const std::string& filePath) const override { return entry_->source->indexOf(filePath); }
+  Mat readSliceHU(unsigned z) const override { return cache_.readSlice(entry_, z); }
+  // Ya en memoria (vista sin copia): no pasa por la caché
+  Mat storedSlice16s(unsigned z, RescaleParams& rescale) const override {
+    return entry_->source->storedSlice16s(z, rescale);
+  }
+  const char* kind() const override { return entry_->source->kind(); }
+
+private:
+  SeriesCache& cache_;
+  std::shared_ptr<SeriesCache::Entry> entry_;
+};
+
+SeriesCache::SeriesCache(size_t budgetBytes, size_t maxSeries)
+    : budget_(budgetBytes), maxSeries_(std::max<size_t>(1, maxSeries)) {}
+
+std::shared_ptr<SliceSource> SeriesCache::open(const std::string& dicomDir) {
+  return std::make_shared<CachedSliceSource>(*this, entryFor(dicomDir));
+}
+
+std::shared_ptr<SliceSource> SeriesCache::openSource(const std::string& dicomDir) {
+  return entryFor(dicomDir)->source;
+}
+
+std::shared_ptr<SeriesCache::Entry> SeriesCache::entryFor(const std::string& dicomDir) {
+  const std::string dir = fs::weakly_canonical(dicomDir).string();
+  std::uint64_t count = 0;
+  std::int64_t mtime = 0;
+  directoryFingerprint(dir, count, mtime);
+
+  // 1. Serie ya abierta y directorio sin cambios: ni índice ni cabeceras
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    auto d = dirs_.find(dir);
+    if (d != dirs_.end()) {
+      auto it = index_.find(d->second);
+      if (it != index_.end() && (*it->second)->count == count && (*it->second)->mtime == mtime) {
+        series_.splice(series_.begin(), series_, it->second);
+        ++stats_.seriesHits;
+        return series_.front();
+      }
+    }
+  }
+
+  // 2. Apertura fuera del mutex (índice/cabeceras o mmap del .huv)
+  auto e = std::make_shared<Entry>();
+  e->source = std::shared_ptr<SliceSource>(openSliceSource(dir));
+  e->key = dir + '|' + e->source->seriesUID();
+  e->count = count;
+  e->mtime = mtime;
+
+  std::lock_guard<std::mutex> lk(m_);
+  ++stats_.seriesMisses;
+  // La serie anterior del directorio (o esta misma, si cambió en disco) ya no vale
+  auto d = dirs_.find(dir);
+  for (const std::string& stale : { d != dirs_.end() ? d->second : std::string(), e->key }) {
+    auto it = index_.find(stale);
+    if (it == index_.end()) continue;
+    dropSeriesLocked(**it->second);
+    series_.erase(it->second);
+    index_.erase(it);
+  }
+  series_.push_front(e);
+  index_[e->key] = series_.begin();
+  dirs_[dir] = e->key;
+  while (series_.size() > maxSeries_) {
+    dropSeriesLocked(*series_.back());
+    index_.erase(series_.back()->key);
+    series_.pop_back();
+  }
+  return e;
+}
+
+Mat SeriesCache::readSlice(const std::shared_ptr<Entry>& e, unsigned z) {
+  Mat cached;
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    if (e->cached) {
+      auto it = e->slices.find(z);
+      if (it != e->slices.end()) {
+        sliceLru_.splice(sliceLru_.begin(), sliceLru_, it->second.second);
+        ++stats_.sliceHits;
+        cached = it->second.first;  // nunca se escribe: basta la referencia
+      } else {
+        ++stats_.sliceMisses;
+      }
+    }
+  }
+  if (!cached.empty()) {
+    // Copia propia para el llamador, que puede escribir en ella
+    Mat hu = threadBufferPool().acquire(cached.size(), CV_32F);
+    cached.copyTo(hu);
+    return hu;
+  }
+
+  Mat hu = e->source->readSliceHU(z);
+  const size_t bytes = hu.total() * hu.elemSize();
+  if (!e->cached || bytes > budget()) return hu;
+  Mat copy = hu.clone();  // fuera del pool: vive en la caché, no en el hilo
+
+  std::lock_guard<std::mutex> lk(m_);
+  if (e->cached && !e->slices.count(z)) {
+    sliceLru_.push_front({ e.get(), z });
+    e->slices.emplace(z, std::make_pair(copy, sliceLru_.begin()));
+    bytes_ += bytes;
+    evictLocked();
+  }
+  return hu;
+}
+
+void SeriesCache::dropSeriesLocked(Entry& e) {
+  for (auto& kv : e.slices) {
+    bytes_ -= kv.second.first.total() * kv.second.first.elemSize();
+    sliceLru_.erase(kv.second.second);
+  }
+  e.slices.clear();
+  e.cached = false;
+}
+
+void SeriesCache::evictLocked() {
+  while (bytes_ > budget_ && !sliceLru_.empty()) {
+    const SliceRef ref = sliceLru_.back();
+    auto it = ref.entry->slices.find(ref.z);
+    bytes_ -= it->second.first.total() * it->second.first.elemSize();
+    ref.entry->slices.erase(it);
+    sliceLru_.pop_back();
+    ++stats_.evictions;
+  }
+}
+
+void SeriesCache::setBudget(size_t budgetBytes) {
+  std::lock_guard<std::mutex> lk(m_);
+  budget_ = budgetBytes;
+  evictLocked();
+}
+
+size_t SeriesCache::budget() const {
+  std::lock_guard<std::mutex> lk(m_);
+  return budget_;
+}
+
+size_t SeriesCache::bytesInUse() const {
+  std::lock_guard<std::mutex> lk(m_);
+  return bytes_;
+}
+
+void SeriesCache::clear() {
+  std::lock_guard<std::mutex> lk(m_);
+  for (auto& e : series_) dropSeriesLocked(*e);
+  series_.clear();
+  index_.clear();
+  dirs_.clear();
+}
+
+SeriesCache::Stats SeriesCache::stats() const {
+  std::lock_guard<std::mutex> lk(m_);
+  return stats_;
+}
+
+SeriesCache& globalSeriesCache() {
+  static SeriesCache cache;
+  return cache;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "slice_source.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Caché de series con clave (directorio, SeriesInstanceUID), presupuesto de
+// memoria y desalojo LRU de los slices HU ya decodificados. Volver a una
+// serie reciente no relee cabeceras (basta la huella del directorio) y los
+// slices visitados no se vuelven a decodificar. Los orígenes se entregan como
+// shared_ptr: uno desalojado sigue sirviendo slices (sin caché) mientras
+// alguien lo use.
+class SeriesCache {
+public:
+  explicit SeriesCache(size_t budgetBytes = size_t(1) << 30,  // 1 GiB de slices
+                       size_t maxSeries = 8);
+
+  // Origen de la serie de dicomDir (openSliceSource la primera vez o si el
+  // directorio cambió) cuyos readSliceHU pasan por la caché de slices.
+  std::shared_ptr<SliceSource> open(const std::string& dicomDir);
+  // El mismo origen compartido pero sin guardar slices: para recorrer la
+  // serie una sola vez (batch) sin desalojar lo que sí se reutiliza.
+  std::shared_ptr<SliceSource> openSource(const std::string& dicomDir);
+
+  void setBudget(size_t budgetBytes);
+  size_t budget() const;
+  size_t bytesInUse() const;
+  void clear();
+
+  struct Stats {
+    size_t seriesHits = 0;    // open/openSource sin volver a abrir la serie
+    size_t seriesMisses = 0;
+    size_t sliceHits = 0;
+    size_t sliceMisses = 0;
+    size_t evictions = 0;     // slices desalojados por presupuesto
+  };
+  Stats stats() const;
+
+private:
+  struct Entry;
+  friend class CachedSliceSource;
+
+  struct SliceRef {
+    Entry* entry;
+    unsigned z;
+  };
+  struct Entry {
+    std::string key;  // dir|uid
+    std::shared_ptr<SliceSource> source;
+    std::uint64_t count = 0;  // huella del directorio al abrir
+    std::int64_t mtime = 0;
+    bool cached = true;       // false tras desalojar la serie entera
+    std::unordered_map<unsigned, std::pair<cv::Mat, std::list<SliceRef>::iterator>> slices;
+  };
+
+  std::shared_ptr<Entry> entryFor(const std::string& dicomDir);
+  cv::Mat readSlice(const std::shared_ptr<Entry>& e, unsigned z);
+  void dropSeriesLocked(Entry& e);
+  void evictLocked();
+
+  mutable std::mutex m_;
+  size_t budget_;
+  size_t maxSeries_;
+  size_t bytes_ = 0;
+  Stats stats_;
+  std::list<std::shared_ptr<Entry>> series_;  // front = usada más recientemente
+  std::unordered_map<std::string, std::list<std::shared_ptr<Entry>>::iterator> index_;
+  std::unordered_map<std::string, std::string> dirs_;  // directorio -> clave de su última serie
+  std::list<SliceRef> sliceLru_;                       // front = usado más recientemente
+};
+
+// Caché compartida por el modo interactivo y batch.
+SeriesCache& globalSeriesCache();
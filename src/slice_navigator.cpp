@@ -0,0 +1,233 @@
+#include "slice_navigator.hpp"
+#include "slice_source.hpp"
+#include "dnn_denoising.hpp"
+#include "profiler.hpp"
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace cv;
+
+namespace {
+
+const char* kControlWindow = "Navegador";
+const char* kCenterBar = "Centro (HU+1000)";
+const char* kWidthBar = "Ancho (HU)";
+constexpr int kCenterOffset = 1000;  // el trackbar empieza en 0: centro de -1000 a 3000 HU
+constexpr int kCenterMax = 4000;
+constexpr int kWidthMax = 4000;
+
+// Desplazamiento de slice para una tecla de waitKeyEx (códigos de GTK, Qt y Win32)
+int stepForKey(int key) {
+  switch (key) {
+    case 0xff51: case 0x1000012: case 0x250000: case 'a': return -1;   // izquierda
+    case 0xff53: case 0x1000014: case 0x270000: case 'd': return 1;    // derecha
+    case 0xff52: case 0x1000013: case 0x260000: case 'w':              // arriba
+    case 0xff55: case 0x1000016: case 0x210000: return 10;             // RePág
+    case 0xff54: case 0x1000015: case 0x280000: case 's':              // abajo
+    case 0xff56: case 0x1000017: case 0x220000: return -10;            // AvPág
+    default: return 0;
+  }
+}
+
+bool sameWindow(HUWindow a, HUWindow b) { return a.center == b.center && a.width == b.width; }
+
+} // namespace
+
+SliceNavigator::SliceNavigator(SliceSource& source, const NavigatorOptions& opt)
+    : source_(source), opt_(opt), denoisers_(std::max(1u, opt.workers)),
+      window_(opt.window), workers_(std::max(1u, opt.workers)) {
+  // Un DnnDenoiser por worker (cv::dnn::Net no es reentrante), cargado y calentado una sola vez
+  std::string error;
+  for (size_t w = 0; w < denoisers_.size() && error.empty(); ++w) {
+    try {
+      denoisers_[w] = std::make_unique<DnnDenoiser>(opt.modelPath);
+      denoisers_[w]->warmUp(source.sliceSize());
+    } catch (const std::exception& e) {
+      error = "worker " + std::to_string(w) + ": " + e.what();
+    }
+  }
+  // Todos los workers o ninguno: los slices no dependen de qué worker los calcule
+  if (!error.empty()) {
+    for (auto& d : denoisers_) d.reset();
+    std::cout << "[AVISO] DNN no disponible (" << error << ").\n";
+  } else {
+    std::cout << "[INIT] DNN Cargado.\n";
+  }
+  // Salida 3: el motor rápido solo si pasa la misma puerta que en batch
+  nlmEngine_ = chooseNLMeansEngine(source, opt.nlmEngine, opt.window);
+}
+
+SliceNavigator::~SliceNavigator() {
+  // Los tokens aún en cola salen sin calcular; los slices en curso terminan
+  // antes de que workers_ (el primer miembro en destruirse) libere los hilos
+  std::lock_guard<std::mutex> lk(cacheMutex_);
+  closing_ = true;
+  cache_.clear();
+  // Fin de la serie: la interfaz (este hilo) suelta los buffers de 8 bits que
+  // repetía con cada ventana; los de los workers se van con sus hilos
+  threadBufferPool().trim();
+}
+
+std::shared_ptr<SliceNavigator::Entry> SliceNavigator::request(int z) {
+  // Con cacheMutex_ tomado. Cada entrada nueva añade un token al pool; el
+  // token calcula la entrada pendiente más cercana al slice actual, no
+  // necesariamente la suya, así que el orden de la cola del pool no importa.
+  auto it = cache_.find(z);
+  if (it != cache_.end()) return it->second;
+  auto e = std::make_shared<Entry>();
+  cache_.emplace(z, e);
+  workers_.submit([this] { workerStep(); });
+  return e;
+}
+
+void SliceNavigator::prefetchAround(int z) {
+  const int n = (int)source_.numSlices();
+  std::lock_guard<std::mutex> lk(cacheMutex_);
+  current_ = z;
+
+  // Fuera del radio (con un slice de margen para no oscilar) se descarta; si
+  // un worker lo está calculando, el resultado se pierde al terminar
+  for (auto it = cache_.begin(); it != cache_.end();) {
+    if (std::abs(it->first - z) > opt_.prefetchRadius + 1) it = cache_.erase(it);
+    else ++it;
+  }
+  for (int d = 0; d <= opt_.prefetchRadius; ++d) {
+    if (z + d < n) request(z + d);
+    if (d > 0 && z - d >= 0) request(z - d);
+  }
+}
+
+void SliceNavigator::workerStep() {
+  std::shared_ptr<Entry> e;
+  int z = 0;
+  HUWindow w;
+  {
+    std::lock_guard<std::mutex> lk(cacheMutex_);
+    if (closing_) return;
+    int best = INT_MAX;
+    for (const auto& kv : cache_) {
+      if (kv.second->state != kQueued) continue;
+      const int dist = std::abs(kv.first - current_);
+      if (dist < best) {
+        best = dist;
+        z = kv.first;
+        e = kv.second;
+      }
+    }
+    if (!e) return;  // ya descartada o calculada por otro token
+    e->state = kRunning;
+    w = window_;
+  }
+
+  try {
+    // Con valores almacenados en memoria (.huv) la ventana sale de la LUT y el
+    // HU float lo calcula el grafo la primera vez que hace falta
+    SliceInput in;
+    {
+      PROFILE_SCOPE("slice_read");
+      // Fast3D: los vecinos en la misma representación que el slice
+      auto read = [&](unsigned k, RescaleParams& rescale) {
+        Mat m = source_.storedSlice16s(k, rescale);
+        return m.empty() ? source_.readSliceHU(k) : m;
+      };
+      const unsigned n = (unsigned)source_.numSlices();
+      Mat slice = read((unsigned)z, in.rescale);
+      if (slice.depth() == CV_16S) in.stored16s = slice;
+      else in.hu32f = slice;
+      if (nlmEngine_ == NLMeansEngine::Fast3D) {
+        RescaleParams r;
+        if (z > 0) in.prevSlice = read((unsigned)z - 1, r);
+        if ((unsigned)z + 1 < n) in.nextSlice = read((unsigned)z + 1, r);
+      }
+    }
+    auto pipeline = std::make_unique<SlicePipeline>(in, denoisers_[ThreadPool::currentWorkerIndex()].get());
+    PipelineOptions po;
+    po.window = w;
+    po.nlmEngine = nlmEngine_;
+    pipeline->run(po);
+    e->pipeline = std::move(pipeline);
+    e->state = kReady;
+  } catch (const std::exception& ex) {
+    e->error = ex.what();
+    e->state = kFailed;
+  }
+}
+
+void SliceNavigator::run(int startSlice) {
+  const int n = (int)source_.numSlices();
+  if (n == 0) return;
+  int z = std::clamp(startSlice, 0, n - 1);
+
+  namedWindow(kControlWindow, WINDOW_AUTOSIZE);
+  createTrackbar(kCenterBar, kControlWindow, nullptr, kCenterMax);
+  createTrackbar(kWidthBar, kControlWindow, nullptr, kWidthMax);
+  setTrackbarMin(kWidthBar, kControlWindow, 1);
+  setTrackbarPos(kCenterBar, kControlWindow, (int)window_.center + kCenterOffset);
+  setTrackbarPos(kWidthBar, kControlWindow, (int)window_.width);
+
+  std::cout << "[NAVEGADOR] " << n << " slices | flechas izq/der: +-1, arriba/abajo: +-10 | "
+            << "trackbars: ventana | ESC: salir\n";
+  prefetchAround(z);
+
+  std::shared_ptr<Entry> shown;  // entrada cuyas salidas están en pantalla
+  std::string shownStatus;
+  Mat panel;
+
+  for (;;) {
+    // window_ solo lo escribe este hilo: leerlo sin mutex es seguro aquí
+    const HUWindow w{ (float)(getTrackbarPos(kCenterBar, kControlWindow) - kCenterOffset),
+                      (float)std::max(1, getTrackbarPos(kWidthBar, kControlWindow)) };
+    if (!sameWindow(w, window_)) {
+      std::lock_guard<std::mutex> lk(cacheMutex_);
+      window_ = w;
+    }
+
+    std::shared_ptr<Entry> e;
+    {
+      std::lock_guard<std::mutex> lk(cacheMutex_);
+      e = request(z);
+    }
+
+    const int state = e->state;
+    bool redraw = false;
+    if (state == kReady && (e != shown || !sameWindow(e->pipeline->window(), w))) {
+      // Ya calculado en segundo plano: a lo sumo se repiten las etapas de 8 bits
+      PipelineOptions po;
+      po.window = w;
+      po.nlmEngine = nlmEngine_;
+      const SliceOutputs& out = e->pipeline->run(po);
+      for (int i = 0; i < kNumOutputs; ++i) imshow(kOutputInfo[i].windowTitle, out.images[i]);
+      shown = e;
+      redraw = true;
+    }
+
+    std::ostringstream status;
+    status << "Slice " << (z + 1) << "/" << n << " | C " << w.center << " W " << w.width;
+    if (state == kFailed) status << " | error: " << e->error;
+    else if (state != kReady) status << " | calculando...";
+    if (redraw || status.str() != shownStatus) {
+      if (shown) cvtColor(shown->pipeline->outputs().images[0], panel, COLOR_GRAY2BGR);
+      else panel = Mat::zeros(source_.sliceSize(), CV_8UC3);
+      putText(panel, status.str(), Point(10, 25), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0, 255, 255), 1);
+      imshow(kControlWindow, panel);
+      shownStatus = status.str();
+    }
+
+    const int key = waitKeyEx(15);
+    if (key == 27 || key == 'q') break;
+    if (getWindowProperty(kControlWindow, WND_PROP_VISIBLE) < 1) break;  // cerrada con la X
+    const int nz = std::clamp(z + stepForKey(key), 0, n - 1);
+    if (nz != z) {
+      z = nz;
+      prefetchAround(z);
+    }
+  }
+  destroyAllWindows();
+}
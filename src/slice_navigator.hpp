@@ -0,0 +1,68 @@
+#pragma once
+#include "pipeline.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SliceSource;
+
+struct NavigatorOptions {
+  std::string modelPath = "../models/dncnn_compatible.onnx";
+  int prefetchRadius = 3;   // slices a cada lado del actual que se preparan en segundo plano
+  unsigned workers = 2;     // hilos de cálculo (cada uno con su DnCNN)
+  HUWindow window = kWindowSoftTissue;
+  // Motor de la salida 3 pedido; si no supera la puerta de PSNR en el slice
+  // central (chooseNLMeansEngine) se usa la referencia de OpenCV
+  NLMeansEngine nlmEngine = NLMeansEngine::FastHU;
+};
+
+// Visor interactivo de una serie: flechas para cambiar de slice y trackbars
+// para el centro/ancho de la ventana. Cada slice tiene su SlicePipeline
+// incremental, así que cambiar la ventana solo repite las etapas de 8 bits
+// (y NLMeans si el motor rápido en HU no pasó la puerta de PSNR).
+// Los vecinos del slice actual se calculan en segundo plano (primero los más
+// cercanos) y los que se alejan se descartan, de modo que la memoria queda
+// acotada a unos 2 × prefetchRadius slices sea cual sea la serie.
+class SliceNavigator {
+public:
+  SliceNavigator(SliceSource& source, const NavigatorOptions& opt = {});
+  ~SliceNavigator();
+
+  SliceNavigator(const SliceNavigator&) = delete;
+  SliceNavigator& operator=(const SliceNavigator&) = delete;
+
+  // Bucle de la interfaz hasta ESC/q. Muestra las 12 salidas y una ventana
+  // de control con el original, los trackbars y el estado.
+  void run(int startSlice);
+
+private:
+  enum State { kQueued, kRunning, kReady, kFailed };
+
+  struct Entry {
+    std::atomic<int> state{kQueued};
+    std::unique_ptr<SlicePipeline> pipeline;  // del worker hasta kReady, luego de la interfaz
+    std::string error;
+  };
+
+  std::shared_ptr<Entry> request(int z);
+  void prefetchAround(int z);
+  void workerStep();
+
+  SliceSource& source_;
+  NavigatorOptions opt_;
+  NLMeansEngine nlmEngine_;  // el de opt_ tras la puerta de PSNR
+  std::vector<std::unique_ptr<DnnDenoiser>> denoisers_;  // uno por worker
+
+  std::mutex cacheMutex_;
+  std::map<int, std::shared_ptr<Entry>> cache_;  // slices cercanos al actual
+  int current_ = 0;                              // protegidos por cacheMutex_
+  HUWindow window_ = kWindowSoftTissue;
+  bool closing_ = false;
+
+  ThreadPool workers_;  // el último: se detiene antes de destruir lo demás
+};
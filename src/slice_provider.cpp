@@ -0,0 +1,82 @@
+#include "slice_provider.hpp"
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+#include <itkGDCMImageIO.h>
+#include <itkImageFileReader.h>
+
+namespace fs = std::filesystem;
+
+LazySliceProvider::LazySliceProvider(const std::string& dicomDir)
+  : LazySliceProvider(findDicomSeries(dicomDir)) {}
+
+LazySliceProvider::LazySliceProvider(DicomSeriesInfo series) : series_(std::move(series)) {
+  if (series_.files.empty()) throw std::runtime_error("Serie DICOM vacía: " + series_.seriesUID);
+  readGeometry();
+  buildLookup();
+}
+
+void LazySliceProvider::buildLookup() {
+  const fs::path dir = fs::path(series_.files.front()).parent_path();
+  for (size_t i = 0; i < series_.files.size(); ++i) {
+    const fs::path p(series_.files[i]);
+    if (p.parent_path() != dir) {
+      zByName_.clear();  // serie repartida: indexOf recorre la lista
+      return;
+    }
+    zByName_.emplace(p.filename().string(), (int)i);
+  }
+  dir_ = fs::weakly_canonical(dir).string();
+}
+
+void LazySliceProvider::readGeometry() {
+  // Solo cabeceras: ReadImageInformation no toca el pixel data.
+  auto io = itk::GDCMImageIO::New();
+  io->SetFileName(series_.files.front());
+  io->ReadImageInformation();
+  spacing_[0] = io->GetSpacing(0);
+  spacing_[1] = io->GetSpacing(1);
+  spacing_[2] = 1.0;
+
+  if (series_.files.size() > 1) {
+    double o0[3], o1[3];
+    for (unsigned i = 0; i < 3; ++i) o0[i] = io->GetOrigin(i);
+    io->SetFileName(series_.files[1]);
+    io->ReadImageInformation();
+    for (unsigned i = 0; i < 3; ++i) o1[i] = io->GetOrigin(i);
+
+    const double dz = std::sqrt((o1[0] - o0[0]) * (o1[0] - o0[0]) +
+                                (o1[1] - o0[1]) * (o1[1] - o0[1]) +
+                                (o1[2] - o0[2]) * (o1[2] - o0[2]));
+    if (dz > 0) spacing_[2] = dz;
+  }
+}
+
+int LazySliceProvider::indexOf(const std::string& filePath) const {
+  const fs::path target = fs::weakly_canonical(fs::path(filePath));
+  if (!dir_.empty()) {
+    if (target.parent_path().string() != dir_) return -1;
+    auto it = zByName_.find(target.filename().string());
+    return it != zByName_.end() ? it->second : -1;
+  }
+  for (size_t i = 0; i < series_.files.size(); ++i) {
+    const fs::path candidate(series_.files[i]);
+    if (candidate.filename() != target.filename()) continue;
+    if (fs::weakly_canonical(candidate) == target) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+ImageType2D::Pointer LazySliceProvider::readSlice(unsigned z) const {
+  if (z >= series_.files.size()) throw std::runtime_error("Índice Z fuera de rango");
+
+  using ReaderType = itk::ImageFileReader<ImageType2D>;
+  auto reader = ReaderType::New();
+  reader->SetImageIO(itk::GDCMImageIO::New());
+  reader->SetFileName(series_.files[z]);
+  reader->Update();
+
+  ImageType2D::Pointer slice = reader->GetOutput();
+  slice->DisconnectPipeline();
+  return slice;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "itk_loader.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Acceso perezoso a los slices de una serie DICOM: las cabeceras se analizan
+// una sola vez (orden Z de GDCM y espaciado) y después solo se decodifica el
+// pixel data de los slices que se piden. Memoria: un slice, no el volumen.
+class LazySliceProvider {
+public:
+  explicit LazySliceProvider(const std::string& dicomDir);
+  explicit LazySliceProvider(DicomSeriesInfo series);
+
+  size_t numSlices() const { return series_.files.size(); }
+  const std::vector<std::string>& files() const { return series_.files; }
+  const std::string& seriesUID() const { return series_.seriesUID; }
+
+  // Espaciado en mm [x, y, z]; z se deduce de la posición de los dos primeros slices.
+  const ImageType3D::SpacingType& spacing() const { return spacing_; }
+
+  // Índice Z (orden GDCM) de un archivo de la serie, o -1 si no pertenece a
+  // ella. O(1) si la serie está en un solo directorio.
+  int indexOf(const std::string& filePath) const;
+
+  // Lee y decodifica únicamente el archivo del slice z. Seguro entre hilos.
+  ImageType2D::Pointer readSlice(unsigned z) const;
+
+private:
+  void readGeometry();
+  void buildLookup();
+
+  DicomSeriesInfo series_;
+  ImageType3D::SpacingType spacing_;
+  std::string dir_;                              // canónico; vacío si hay varios directorios
+  std::unordered_map<std::string, int> zByName_; // nombre de archivo -> Z
+};
@@ -0,0 +1,153 @@
+#include "slice_source.hpp"
+#include "slice_provider.hpp"
+#include "dicom_index.hpp"
+#include "hu_volume.hpp"
+#include "itk_opencv_bridge.hpp"
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <itkGDCMImageIO.h>
+
+using namespace cv;
+namespace fs = std::filesystem;
+
+namespace {
+
+class DicomSliceSource : public SliceSource {
+public:
+  explicit DicomSliceSource(DicomSeriesInfo series) : provider_(std::move(series)) {
+    auto io = itk::GDCMImageIO::New();
+    io->SetFileName(provider_.files().front());
+    io->ReadImageInformation();
+    size_ = Size((int)io->GetDimensions(0), (int)io->GetDimensions(1));
+  }
+
+  size_t numSlices() const override { return provider_.numSlices(); }
+  Size sliceSize() const override { return size_; }
+  Vec3d spacing() const override {
+    const auto& s = provider_.spacing();
+    return Vec3d(s[0], s[1], s[2]);
+  }
+  std::string seriesUID() const override { return provider_.seriesUID(); }
+  int indexOf(const std::string& filePath) const override { return provider_.indexOf(filePath); }
+  Mat readSliceHU(unsigned z) const override { return itk2cv32fHU(provider_.readSlice(z)); }
+  const char* kind() const override { return "DICOM"; }
+
+private:
+  LazySliceProvider provider_;
+  Size size_;
+};
+
+class MappedSliceSource : public SliceSource {
+public:
+  explicit MappedSliceSource(const std::string& path) : volume_(path) {}
+
+  size_t numSlices() const override { return volume_.numSlices(); }
+  Size sliceSize() const override { return Size(volume_.width(), volume_.height()); }
+  Vec3d spacing() const override {
+    const double* s = volume_.header().spacing;
+    return Vec3d(s[0], s[1], s[2]);
+  }
+  std::string seriesUID() const override {
+    const char* uid = volume_.header().seriesUID;
+    return std::string(uid, strnlen(uid, sizeof(volume_.header().seriesUID)));
+  }
+  int indexOf(const std::string& filePath) const override { return volume_.indexOf(filePath); }
+  Mat readSliceHU(unsigned z) const override {
+    Mat hu = threadBufferPool().acquire(sliceSize(), CV_32F);
+    volume_.sliceHU32f(z, hu);
+    return hu;
+  }
+  Mat storedSlice16s(unsigned z, RescaleParams& rescale) const override {
+    rescale.slope = volume_.header().slope;
+    rescale.intercept = volume_.header().intercept;
+    return volume_.sliceView16s(z);
+  }
+  const char* kind() const override { return "HUV (mmap)"; }
+
+  const MappedHUVolume& volume() const { return volume_; }
+
+private:
+  MappedHUVolume volume_;
+};
+
+class ItkVolumeSliceSource : public SliceSource {
+public:
+  explicit ItkVolumeSliceSource(ImageType3D::Pointer vol) : vol_(std::move(vol)) {}
+
+  size_t numSlices() const override { return vol_->GetLargestPossibleRegion().GetSize()[2]; }
+  Size sliceSize() const override {
+    const auto size = vol_->GetLargestPossibleRegion().GetSize();
+    return Size((int)size[0], (int)size[1]);
+  }
+  Vec3d spacing() const override {
+    const auto& s = vol_->GetSpacing();
+    return Vec3d(s[0], s[1], s[2]);
+  }
+  std::string seriesUID() const override { return {}; }
+  int indexOf(const std::string&) const override { return -1; }  // sin lista de archivos
+  Mat readSliceHU(unsigned z) const override {
+    Mat hu = threadBufferPool().acquire(sliceSize(), CV_32F);
+    convert16sToHU32f(itkVolumeSliceView16s(vol_, z), hu);
+    return hu;
+  }
+  Mat storedSlice16s(unsigned z, RescaleParams& rescale) const override {
+    rescale = {};  // GDCM ya entrega HU
+    return itkVolumeSliceView16s(vol_, z);
+  }
+  const char* kind() const override { return "ITK (memoria)"; }
+
+private:
+  ImageType3D::Pointer vol_;
+};
+
+} // namespace
+
+std::unique_ptr<SliceSource> wrapItkVolume(const ImageType3D::Pointer& vol) {
+  return std::make_unique<ItkVolumeSliceSource>(vol);
+}
+
+std::string defaultHUVolumePath(const std::string& dicomDir) {
+  const std::string canonical = fs::weakly_canonical(dicomDir).string();
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016zx.huv", std::hash<std::string>{}(canonical));
+  return (fs::path("outputs/cache") / name).string();
+}
+
+std::unique_ptr<SliceSource> openSliceSource(const std::string& dicomDir) {
+  const std::string path = defaultHUVolumePath(dicomDir);
+  if (fs::exists(path)) {
+    try {
+      auto src = std::make_unique<MappedSliceSource>(path);
+      const HUVolumeHeader& h = src->volume().header();
+
+      std::uint64_t count = 0;
+      std::int64_t mtime = 0;
+      directoryFingerprint(dicomDir, count, mtime);
+      const std::string sourceDir(h.sourceDir, strnlen(h.sourceDir, sizeof(h.sourceDir)));
+      const bool sameDir = fs::weakly_canonical(dicomDir).string() == sourceDir;
+      if (sameDir && count == h.sourceCount && mtime == h.sourceMTime) return src;
+      std::cout << "[AVISO] Volumen HUV desactualizado, se lee DICOM (regenerar con --convert)\n";
+    } catch (const std::exception& e) {
+      // Corrupto o de otra versión: también se cae a DICOM
+      std::cout << "[AVISO] " << e.what() << "\n";
+    }
+  }
+  // Orden Z desde el índice persistente: solo se releen las cabeceras que cambiaron
+  return std::make_unique<DicomSliceSource>(indexedDicomSeries(dicomDir));
+}
+
+std::vector<Mat> sampleSlicesHU(const SliceSource& source, unsigned count) {
+  const size_t n = source.numSlices();
+  const size_t k = std::min<size_t>(n, count);
+  std::vector<Mat> slices;
+  slices.reserve(k);
+  // Centro de cada uno de los k tramos iguales de la serie
+  for (size_t i = 0; i < k; ++i) slices.push_back(source.readSliceHU((unsigned)((2 * i + 1) * n / (2 * k))));
+  return slices;
+}
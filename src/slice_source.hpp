@@ -0,0 +1,51 @@
+#pragma once
+#include "itk_loader.hpp"
+#include "itk_opencv_bridge.hpp"  // RescaleParams
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Origen de slices HU de una serie, sea DICOM (LazySliceProvider) o un
+// volumen .huv proyectado en memoria (MappedHUVolume).
+class SliceSource {
+public:
+  virtual ~SliceSource() = default;
+
+  virtual size_t numSlices() const = 0;
+  virtual cv::Size sliceSize() const = 0;
+  // Espaciado en mm [x, y, z].
+  virtual cv::Vec3d spacing() const = 0;
+  // SeriesInstanceUID, o vacío si no se conoce (volumen ya cargado).
+  virtual std::string seriesUID() const = 0;
+  // Índice Z de un archivo de la serie, o -1 si no pertenece a ella.
+  virtual int indexOf(const std::string& filePath) const = 0;
+  // Slice z en HU (CV_32F). Seguro entre hilos.
+  virtual cv::Mat readSliceHU(unsigned z) const = 0;
+  // Valores almacenados del slice z (CV_16S) sin copia, con su reescalado a
+  // HU, si el origen los tiene en memoria (.huv por mmap, volumen ITK): vista
+  // de solo lectura, válida mientras viva el origen. Vacío si no (DICOM se
+  // decodifica directamente a HU). Seguro entre hilos.
+  virtual cv::Mat storedSlice16s(unsigned z, RescaleParams& rescale) const {
+    (void)z;
+    rescale = {};
+    return cv::Mat();
+  }
+  // Para los mensajes: "DICOM" o "HUV (mmap)".
+  virtual const char* kind() const = 0;
+};
+
+// Adaptador sobre un volumen ya cargado (loadDicomSeries): vistas sin copia.
+// El volumen debe sobrevivir al SliceSource.
+std::unique_ptr<SliceSource> wrapItkVolume(const ImageType3D::Pointer& vol);
+
+// Ruta por defecto del .huv de una serie: outputs/cache/<hash del directorio>.huv
+std::string defaultHUVolumePath(const std::string& dicomDir);
+
+// Abre el .huv de la serie si existe y sigue al día (mismo directorio y misma
+// huella de archivos); si no, la serie DICOM con lectura perezosa.
+std::unique_ptr<SliceSource> openSliceSource(const std::string& dicomDir);
+
+// count slices equiespaciados de la serie en HU (todos si tiene menos), p.ej.
+// para calibrar DnCNN INT8.
+std::vector<cv::Mat> sampleSlicesHU(const SliceSource& source, unsigned count);
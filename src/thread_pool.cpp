@@ -0,0 +1,96 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace {
+thread_local int tlsWorkerIndex = -1;
+thread_local const void* tlsOwnerPool = nullptr;
+}
+
+ThreadPool::ThreadPool(unsigned numThreads) {
+  if (numThreads == 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  queues_.reserve(numThreads);
+  for (unsigned i = 0; i < numThreads; ++i) queues_.push_back(std::make_unique<WorkerQueue>());
+
+  workers_.reserve(numThreads);
+  for (unsigned i = 0; i < numThreads; ++i) workers_.emplace_back([this, i] { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lk(sleepMutex_);
+    stop_ = true;
+  }
+  wakeCv_.notify_all();
+  for (auto& t : workers_) t.join();
+}
+
+int ThreadPool::currentWorkerIndex() { return tlsWorkerIndex; }
+
+void ThreadPool::submit(Task task) {
+  // Desde un worker propio se encola localmente; desde fuera, round-robin.
+  unsigned q;
+  if (tlsOwnerPool == this) q = static_cast<unsigned>(tlsWorkerIndex);
+  else q = nextQueue_.fetch_add(1, std::memory_order_relaxed) % size();
+
+  pending_.fetch_add(1);
+  queued_.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lk(queues_[q]->m);
+    queues_[q]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lk(sleepMutex_);
+  }
+  wakeCv_.notify_one();
+}
+
+void ThreadPool::waitIdle() {
+  std::unique_lock<std::mutex> lk(sleepMutex_);
+  idleCv_.wait(lk, [this] { return pending_.load() == 0; });
+}
+
+bool ThreadPool::tryPopLocal(unsigned self, Task& out) {
+  auto& q = *queues_[self];
+  std::lock_guard<std::mutex> lk(q.m);
+  if (q.tasks.empty()) return false;
+  out = std::move(q.tasks.back());
+  q.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::trySteal(unsigned self, Task& out) {
+  const unsigned n = size();
+  for (unsigned k = 1; k < n; ++k) {
+    auto& q = *queues_[(self + k) % n];
+    std::lock_guard<std::mutex> lk(q.m);
+    if (q.tasks.empty()) continue;
+    out = std::move(q.tasks.front());
+    q.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(unsigned idx) {
+  tlsWorkerIndex = static_cast<int>(idx);
+  tlsOwnerPool = this;
+
+  for (;;) {
+    Task task;
+    if (tryPopLocal(idx, task) || trySteal(idx, task)) {
+      queued_.fetch_sub(1);
+      task();
+      task = nullptr;
+      if (pending_.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lk(sleepMutex_);
+        idleCv_.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lk(sleepMutex_);
+    wakeCv_.wait(lk, [this] { return stop_ || queued_.load() > 0; });
+    if (stop_ && queued_.load() == 0) return;
+  }
+}
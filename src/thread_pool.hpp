@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool de hilos con robo de trabajo (work-stealing).
+// Cada worker tiene su propia cola: el dueño saca por el final (LIFO, mejor
+// localidad de caché) y los demás roban por el principio (FIFO) cuando se
+// quedan sin trabajo. Las tareas enviadas desde fuera del pool se reparten
+// en round-robin entre las colas. Las tareas no deben dejar escapar
+// excepciones: quien las envía es responsable de capturarlas.
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+  // numThreads = 0 => std::thread::hardware_concurrency()
+  explicit ThreadPool(unsigned numThreads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(Task task);
+
+  // Bloquea hasta que todas las tareas enviadas hayan terminado.
+  void waitIdle();
+
+  unsigned size() const { return static_cast<unsigned>(queues_.size()); }
+
+  // Índice del worker que ejecuta la llamada, o -1 si no es un hilo del pool.
+  static int currentWorkerIndex();
+
+private:
+  struct WorkerQueue {
+    std::mutex m;
+    std::deque<Task> tasks;
+  };
+
+  bool tryPopLocal(unsigned self, Task& out);
+  bool trySteal(unsigned self, Task& out);
+  void workerLoop(unsigned idx);
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex sleepMutex_;
+  std::condition_variable wakeCv_;
+  std::condition_variable idleCv_;
+
+  std::atomic<size_t> pending_{0};   // tareas encoladas o en ejecución
+  std::atomic<size_t> queued_{0};    // tareas encoladas aún sin tomar
+  std::atomic<unsigned> nextQueue_{0};
+  bool stop_ = false;
+};
@@ -0,0 +1,252 @@
+#include "volume_segmentation.hpp"
+#include "slice_source.hpp"
+#include "morphology.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <opencv2/imgproc.hpp>
+
+using namespace cv;
+
+namespace {
+
+// La cadena más larga (músculo: apertura + cierre) son 4 erosiones/dilataciones
+// y cada una invalida un slice más en los bordes del slab.
+constexpr int kHalo = 4;
+// Bytes por vóxel retenidos en un slab: 3 máscaras + temporal 2D + etiquetas + ids int32
+constexpr size_t kBytesPerVoxel = 10;
+
+// Union-find concurrente sin bloqueos (enlaza siempre la raíz mayor a la menor,
+// compresión por "halving" con CAS). grow() solo entre fases paralelas.
+class ConcurrentUnionFind {
+public:
+  size_t size() const { return size_; }
+
+  void grow(size_t n) {
+    if (n <= size_) return;
+    if (n > cap_) {
+      const size_t cap = std::max(n, cap_ * 2);
+      std::unique_ptr<std::atomic<uint32_t>[]> p(new std::atomic<uint32_t>[cap]);
+      for (size_t i = 0; i < size_; ++i) p[i].store(parent_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+      parent_ = std::move(p);
+      cap_ = cap;
+    }
+    for (size_t i = size_; i < n; ++i) parent_[i].store((uint32_t)i, std::memory_order_relaxed);
+    size_ = n;
+  }
+
+  uint32_t find(uint32_t x) {
+    for (;;) {
+      uint32_t p = parent_[x].load(std::memory_order_relaxed);
+      if (p == x) return x;
+      const uint32_t gp = parent_[p].load(std::memory_order_relaxed);
+      if (p != gp) parent_[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+      x = gp;
+    }
+  }
+
+  void unite(uint32_t a, uint32_t b) {
+    for (;;) {
+      a = find(a);
+      b = find(b);
+      if (a == b) return;
+      if (a < b) std::swap(a, b);
+      uint32_t expected = a;
+      if (parent_[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
+    }
+  }
+
+private:
+  std::unique_ptr<std::atomic<uint32_t>[]> parent_;
+  size_t size_ = 0, cap_ = 0;
+};
+
+struct MorphOp {
+  bool erode;
+  Mat kernel;
+};
+
+// Una erosión/dilatación 3D con elemento cilíndrico: la 2D de cada slice y
+// después min/max con los vecinos en Z. Fuera del slab no hay vecinos (igual
+// que en los bordes del volumen); el error que eso mete en los extremos del
+// slab avanza un slice por operación y lo absorbe el halo.
+void morph3D(std::vector<Mat>& masks, const MorphOp& op, std::vector<Mat>& planar) {
+  const int n = (int)masks.size();
+  planar.resize(n);
+  parallel_for_(Range(0, n), [&](const Range& r) {
+    for (int i = r.start; i < r.end; ++i) {
+      if (op.erode) erodeFast(masks[i], planar[i], op.kernel);
+      else dilateFast(masks[i], planar[i], op.kernel);
+    }
+  });
+  parallel_for_(Range(0, n), [&](const Range& r) {
+    for (int i = r.start; i < r.end; ++i) {
+      Mat& out = masks[i];
+      planar[i].copyTo(out);
+      for (int j : {i - 1, i + 1}) {
+        if (j < 0 || j >= n) continue;
+        if (op.erode) min(out, planar[j], out);
+        else max(out, planar[j], out);
+      }
+    }
+  });
+}
+
+// Datos de etiquetado 2D de un slice: ids locales (CV_32S, 0 = fondo) y el
+// primer id global que les corresponde.
+struct SliceComponents {
+  Mat ids;
+  Mat labels;
+  uint32_t base = 0;
+};
+
+// Une las componentes de dos slices consecutivos que se tocan en Z con el mismo tejido.
+void uniteAcross(const SliceComponents& a, const SliceComponents& b, ConcurrentUnionFind& uf) {
+  for (int y = 0; y < a.ids.rows; ++y) {
+    const int* ia = a.ids.ptr<int>(y);
+    const int* ib = b.ids.ptr<int>(y);
+    const uchar* la = a.labels.ptr<uchar>(y);
+    const uchar* lb = b.labels.ptr<uchar>(y);
+    int lastA = 0, lastB = 0;
+    for (int x = 0; x < a.ids.cols; ++x) {
+      if (!la[x] || la[x] != lb[x]) continue;
+      if (ia[x] == lastA && ib[x] == lastB) continue;  // mismo par que el píxel anterior
+      lastA = ia[x];
+      lastB = ib[x];
+      uf.unite(a.base + ia[x] - 1, b.base + ib[x] - 1);
+    }
+  }
+}
+
+} // namespace
+
+VolumeSegmentation segmentVolume(const SliceSource& src, const VolumeSegmentationOptions& opt) {
+  const int D = (int)src.numSlices();
+  const Size size = src.sliceSize();
+  if (D == 0 || size.area() == 0) throw std::runtime_error("Volumen vacío");
+  const Vec3d sp = src.spacing();
+
+  VolumeSegmentation result;
+  result.voxelMl = sp[0] * sp[1] * sp[2] / 1000.0;
+
+  // Slab = núcleo + halo a cada lado, dentro del presupuesto
+  const size_t sliceBytes = (size_t)size.area() * kBytesPerVoxel;
+  const int slabSlices = (int)std::max<size_t>(2 * kHalo + 1, opt.memoryBudget / sliceBytes);
+  const int core = std::min(D, slabSlices - 2 * kHalo);
+  result.slabCoreSlices = core;
+
+  const Mat k3 = getStructuringElement(MORPH_ELLIPSE, Size(3, 3));
+  const Mat k5 = getStructuringElement(MORPH_ELLIPSE, Size(5, 5));
+  // Mismo esquema que generateTissueLabelsHU, ahora en 3D. Índice 0..2 = grasa, músculo, hueso
+  const std::vector<MorphOp> chains[3] = {
+    {{true, k3}, {false, k3}},                             // grasa: apertura 3
+    {{true, k3}, {false, k3}, {false, k5}, {true, k5}},    // músculo: apertura 3 + cierre 5
+    {{false, k3}, {true, k3}},                             // hueso: cierre 3
+  };
+  const TissueThresholds& t = opt.thresholds;
+
+  ConcurrentUnionFind uf;
+  std::vector<uint64_t> area;   // vóxeles de cada componente 2D (id global)
+  std::vector<uchar> tissueOf;  // tejido de cada id global
+  SliceComponents prev;         // último slice del slab anterior
+  std::vector<Mat> planar;
+
+  for (int c0 = 0; c0 < D; c0 += core) {
+    const int c1 = std::min(D, c0 + core);
+    const int l0 = std::max(0, c0 - kHalo), l1 = std::min(D, c1 + kHalo);
+    const int n = l1 - l0;
+    ++result.slabs;
+    if (opt.verbose)
+      std::cout << "[SEG3D] Slab " << result.slabs << " (z " << c0 << "-" << (c1 - 1)
+                << ", leídos " << l0 << "-" << (l1 - 1) << ")\n";
+
+    // 1. Lectura + clasificación en paralelo; el HU se suelta en cuanto se clasifica
+    std::vector<Mat> masks[3];
+    for (auto& m : masks) m.resize(n);
+    parallel_for_(Range(0, n), [&](const Range& r) {
+      for (int i = r.start; i < r.end; ++i) {
+        thresholdTissuesHU(src.readSliceHU(l0 + i), t, masks[0][i], masks[1][i], masks[2][i]);
+      }
+    });
+
+    // 2. Morfología 3D por tejido
+    for (int k = 0; k < 3; ++k)
+      for (const MorphOp& op : chains[k]) morph3D(masks[k], op, planar);
+    planar.clear();
+
+    // 3. Jerarquía + 4a. etiquetado 2D de los slices del núcleo
+    const int nc = c1 - c0;
+    std::vector<SliceComponents> comps(nc);
+    std::vector<std::vector<int>> localArea(nc);  // índice = id local - 1
+    std::vector<std::vector<uchar>> localTissue(nc);
+    parallel_for_(Range(0, nc), [&](const Range& r) {
+      Mat cc, stats, centroids, bin;
+      for (int j = r.start; j < r.end; ++j) {
+        const int i = c0 - l0 + j;
+        Mat labels;
+        resolveTissueHierarchy(masks[0][i], masks[1][i], masks[2][i], labels);
+
+        Mat ids = Mat::zeros(size, CV_32S);
+        int offset = 0;
+        for (int tissue = TISSUE_FAT; tissue <= TISSUE_BONE; ++tissue) {
+          compare(labels, Scalar(tissue), bin, CMP_EQ);
+          const int count = connectedComponentsWithStats(bin, cc, stats, centroids, 4, CV_32S);
+          for (int c = 1; c < count; ++c) {
+            localArea[j].push_back(stats.at<int>(c, CC_STAT_AREA));
+            localTissue[j].push_back((uchar)tissue);
+          }
+          // ids = cc + offset donde hay tejido (cc = 0 fuera)
+          if (count > 1) add(cc, Scalar(offset), ids, bin);
+          offset += count - 1;
+        }
+        comps[j].ids = ids;
+        comps[j].labels = labels;
+      }
+    });
+    for (auto& m : masks) m.clear();
+
+    // Ids globales: prefijo sobre los slices del núcleo
+    for (int j = 0; j < nc; ++j) {
+      comps[j].base = (uint32_t)area.size();
+      area.insert(area.end(), localArea[j].begin(), localArea[j].end());
+      tissueOf.insert(tissueOf.end(), localTissue[j].begin(), localTissue[j].end());
+    }
+    uf.grow(area.size());
+
+    // 4b. Uniones en Z en paralelo (incluido el borde con el slab anterior)
+    const bool hasPrev = !prev.ids.empty();
+    parallel_for_(Range(hasPrev ? -1 : 0, nc - 1), [&](const Range& r) {
+      for (int j = r.start; j < r.end; ++j)
+        uniteAcross(j < 0 ? prev : comps[j], comps[j + 1], uf);
+    });
+
+    if (opt.onSlice)
+      for (int j = 0; j < nc; ++j) opt.onSlice((unsigned)(c0 + j), comps[j].labels);
+    prev = comps.back();
+  }
+
+  // Volúmenes por componente 3D (raíz del union-find) y por tejido
+  std::vector<uint64_t> compVoxels(area.size(), 0);
+  for (uint32_t id = 0; id < area.size(); ++id) compVoxels[uf.find(id)] += area[id];
+
+  const double minVoxels = opt.minComponentMl / result.voxelMl;
+  for (uint32_t id = 0; id < area.size(); ++id) {
+    if (!compVoxels[id]) continue;  // no es raíz
+    TissueVolume& tv = result.tissues[tissueOf[id]];
+    const double ml = compVoxels[id] * result.voxelMl;
+    tv.voxels += compVoxels[id];
+    ++tv.components;
+    tv.largestComponentMl = std::max(tv.largestComponentMl, ml);
+    if (compVoxels[id] >= minVoxels) tv.volumeMlFiltered += ml;
+  }
+  for (auto& tv : result.tissues) tv.volumeMl = tv.voxels * result.voxelMl;
+  return result;
+}
+
+VolumeSegmentation segmentVolume(const ImageType3D::Pointer& vol, const VolumeSegmentationOptions& opt) {
+  return segmentVolume(*wrapItkVolume(vol), opt);
+}
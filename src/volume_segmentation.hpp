@@ -0,0 +1,50 @@
+#pragma once
+#include "highlight.hpp"
+#include "itk_loader.hpp"
+
+#include <opencv2/core.hpp>
+#include <array>
+#include <cstdint>
+#include <functional>
+
+class SliceSource;
+
+// Segmentación volumétrica de tejidos (grasa, músculo, hueso) con continuidad
+// en Z, en lugar de slice a slice como generateAnatomicalMasksHU:
+//  1. clasificación HU por slice en paralelo (mismos umbrales);
+//  2. morfología 3D con el mismo esquema que la 2D (hueso: cierre 3;
+//     músculo: apertura 3 + cierre 5; grasa: apertura 3) con un elemento
+//     cilíndrico (elipse en el plano × 3 slices);
+//  3. jerarquía hueso > músculo > grasa;
+//  4. componentes conexas 3D (6-conexión): etiquetado 2D por slice en paralelo
+//     y unión entre slices vecinos con un union-find concurrente sin bloqueos.
+// El volumen se recorre en slabs Z solapados (halo de 4 slices, lo que
+// consume la cadena de morfología más larga) dimensionados según el
+// presupuesto de memoria, así que nunca se necesita el volumen entero.
+struct VolumeSegmentationOptions {
+  TissueThresholds thresholds;
+  size_t memoryBudget = size_t(512) << 20;  // bytes para los slabs
+  double minComponentMl = 0.1;  // componentes menores no cuentan en volumeMlFiltered
+  bool verbose = false;
+  // Etiquetas finales (TissueLabel, CV_8U) de cada slice, en orden Z creciente.
+  std::function<void(unsigned z, const cv::Mat& labels)> onSlice;
+};
+
+struct TissueVolume {
+  std::uint64_t voxels = 0;
+  double volumeMl = 0;
+  size_t components = 0;
+  double largestComponentMl = 0;
+  double volumeMlFiltered = 0;  // sin las componentes de menos de minComponentMl
+};
+
+struct VolumeSegmentation {
+  std::array<TissueVolume, kNumTissueLabels> tissues;  // índice = TissueLabel
+  double voxelMl = 0;
+  unsigned slabs = 0;
+  unsigned slabCoreSlices = 0;
+};
+
+VolumeSegmentation segmentVolume(const SliceSource& src, const VolumeSegmentationOptions& opt = {});
+// Sobre el volumen de loadDicomSeries (vistas sin copia).
+VolumeSegmentation segmentVolume(const ImageType3D::Pointer& vol, const VolumeSegmentationOptions& opt = {});
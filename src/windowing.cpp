@@ -0,0 +1,149 @@
+#include "windowing.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+using namespace cv;
+
+// (hu - low) / (high - low) * 255  ==  hu * scale + shift
+static void windowCoeffs(HUWindow w, float& scale, float& shift) {
+  const float low = w.center - w.width * 0.5f;
+  scale = 255.0f / std::max(1e-6f, w.width);
+  shift = -low * scale;
+}
+
+WindowLUT::WindowLUT(HUWindow w, RescaleParams rescale) : table_(65536) {
+  float scale, shift;
+  windowCoeffs(w, scale, shift);
+  for (int v = -32768; v <= 32767; ++v) {
+    const float hu = (float)(v * rescale.slope + rescale.intercept);
+    table_[(unsigned short)(short)v] = saturate_cast<uchar>(hu * scale + shift);
+  }
+}
+
+void WindowLUT::apply(const Mat& src, Mat& dst) const {
+  CV_Assert(src.type() == CV_16S);
+  dst.create(src.size(), CV_8U);
+  const uchar* t = table_.data();
+  for (int y = 0; y < src.rows; ++y) {
+    const short* s = src.ptr<short>(y);
+    uchar* d = dst.ptr<uchar>(y);
+    for (int x = 0; x < src.cols; ++x) d[x] = t[(unsigned short)s[x]];
+  }
+}
+
+std::shared_ptr<const WindowLUT> cachedWindowLUT(HUWindow w, RescaleParams rescale) {
+  using Key = std::tuple<float, float, double, double>;
+  static std::mutex m;
+  static std::map<Key, std::shared_ptr<const WindowLUT>> cache;
+
+  const Key key{ w.center, w.width, rescale.slope, rescale.intercept };
+  std::lock_guard<std::mutex> lk(m);
+  auto it = cache.find(key);
+  if (it != cache.end()) return it->second;
+  if (cache.size() >= 64) cache.clear();  // ventanas arbitrarias (trackbars): acotar memoria
+  auto lut = std::make_shared<const WindowLUT>(w, rescale);
+  cache.emplace(key, lut);
+  return lut;
+}
+
+// Una fila float → 8U: fma + redondeo + empaquetado con saturación.
+static void windowRow32f(const float* src, uchar* dst, int n, float scale, float shift) {
+  int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+  const int VL8 = VTraits<v_uint8>::vlanes();
+  const int VL32 = VTraits<v_float32>::vlanes();
+  v_float32 vs = vx_setall_f32(scale), vb = vx_setall_f32(shift);
+  for (; x <= n - VL8; x += VL8) {
+    v_int32 i0 = v_round(v_fma(vx_load(src + x), vs, vb));
+    v_int32 i1 = v_round(v_fma(vx_load(src + x + VL32), vs, vb));
+    v_int32 i2 = v_round(v_fma(vx_load(src + x + 2 * VL32), vs, vb));
+    v_int32 i3 = v_round(v_fma(vx_load(src + x + 3 * VL32), vs, vb));
+    v_store(dst + x, v_pack_u(v_pack(i0, i1), v_pack(i2, i3)));
+  }
+  vx_cleanup();
+#endif
+  for (; x < n; ++x) dst[x] = saturate_cast<uchar>(src[x] * scale + shift);
+}
+
+void applyWindow(const Mat& hu, Mat& dst, HUWindow w, RescaleParams rescale) {
+  if (hu.type() == CV_16S) {
+    cachedWindowLUT(w, rescale)->apply(hu, dst);
+    return;
+  }
+  CV_Assert(hu.type() == CV_32F);
+  dst.create(hu.size(), CV_8U);
+
+  float scale, shift;
+  windowCoeffs(w, scale, shift);
+  int rows = hu.rows, cols = hu.cols;
+  if (hu.isContinuous() && dst.isContinuous()) { cols *= rows; rows = 1; }
+  for (int y = 0; y < rows; ++y) windowRow32f(hu.ptr<float>(y), dst.ptr<uchar>(y), cols, scale, shift);
+}
+
+void applyWindows(const Mat& hu, const std::vector<HUWindow>& windows, std::vector<Mat>& dsts,
+                  RescaleParams rescale) {
+  CV_Assert(hu.type() == CV_16S || hu.type() == CV_32F);
+  const size_t n = windows.size();
+  dsts.resize(n);
+  for (auto& d : dsts) d.create(hu.size(), CV_8U);
+
+  if (hu.type() == CV_16S) {
+    std::vector<const uchar*> tables(n);
+    std::vector<std::shared_ptr<const WindowLUT>> luts(n);
+    for (size_t i = 0; i < n; ++i) {
+      luts[i] = cachedWindowLUT(windows[i], rescale);
+      tables[i] = luts[i]->table();
+    }
+
+    std::vector<uchar*> rows(n);
+    for (int y = 0; y < hu.rows; ++y) {
+      const short* s = hu.ptr<short>(y);
+      for (size_t i = 0; i < n; ++i) rows[i] = dsts[i].ptr<uchar>(y);
+      for (int x = 0; x < hu.cols; ++x) {
+        const unsigned short v = (unsigned short)s[x];
+        for (size_t i = 0; i < n; ++i) rows[i][x] = tables[i][v];
+      }
+    }
+    return;
+  }
+
+  std::vector<float> scale(n), shift(n);
+  for (size_t i = 0; i < n; ++i) windowCoeffs(windows[i], scale[i], shift[i]);
+  for (int y = 0; y < hu.rows; ++y) {
+    const float* s = hu.ptr<float>(y);
+    for (size_t i = 0; i < n; ++i) windowRow32f(s, dsts[i].ptr<uchar>(y), hu.cols, scale[i], shift[i]);
+  }
+}
+
+std::vector<HUWindow> parseWindowList(const std::string& list) {
+  std::vector<HUWindow> windows;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) continue;
+    if (item == "soft") windows.push_back(kWindowSoftTissue);
+    else if (item == "bone") windows.push_back(kWindowBone);
+    else if (item == "lung") windows.push_back(kWindowLung);
+    else {
+      const size_t slash = item.find('/');
+      float center = 0.0f, width = 0.0f;
+      try {
+        if (slash == std::string::npos) throw std::invalid_argument(item);
+        center = std::stof(item.substr(0, slash));
+        width = std::stof(item.substr(slash + 1));
+      } catch (...) {
+        width = 0.0f;
+      }
+      if (!(width > 0.0f))
+        throw std::runtime_error("Ventana desconocida (soft|bone|lung|centro/ancho): " + item);
+      windows.push_back(HUWindow{ center, width });
+    }
+  }
+  if (windows.empty()) throw std::runtime_error("Lista de ventanas vacía: " + list);
+  return windows;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "itk_opencv_bridge.hpp"  // RescaleParams
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Ventana DICOM (center/width) en HU.
+struct HUWindow {
+  float center;
+  float width;
+};
+
+constexpr HUWindow kWindowSoftTissue{ 40.0f, 400.0f };
+constexpr HUWindow kWindowBone{ 400.0f, 1800.0f };
+constexpr HUWindow kWindowLung{ -600.0f, 1500.0f };
+
+// Tabla de 64K entradas (una por valor int16 almacenado) → 8 bits para una
+// ventana dada. Incluye el reescalado slope/intercept.
+class WindowLUT {
+public:
+  explicit WindowLUT(HUWindow w, RescaleParams rescale = {});
+
+  // src CV_16S → dst CV_8U (dst se reasigna solo si cambia el tamaño).
+  void apply(const cv::Mat& src16s, cv::Mat& dst8u) const;
+
+  const uchar* table() const { return table_.data(); }
+  uchar operator()(short v) const { return table_[(unsigned short)v]; }
+
+private:
+  std::vector<uchar> table_;
+};
+
+// LUT compartida para (ventana, reescalado); se construye una sola vez. Seguro entre hilos.
+std::shared_ptr<const WindowLUT> cachedWindowLUT(HUWindow w, RescaleParams rescale = {});
+
+// Ventaneo en una sola pasada. CV_16S (valores almacenados, con su
+// reescalado) usa la LUT; CV_32F (HU) usa el núcleo SIMD fusionado (escala +
+// desplazamiento + redondeo + saturación) y no usa rescale.
+void applyWindow(const cv::Mat& hu, cv::Mat& dst8u, HUWindow w, RescaleParams rescale = {});
+
+// Varias ventanas a partir de una sola lectura del slice (fila a fila, la
+// fila de entrada se reutiliza desde caché para todas las ventanas). dsts8u
+// se redimensiona a windows.size(); sus buffers se reutilizan si ya tienen
+// el tamaño correcto.
+void applyWindows(const cv::Mat& hu, const std::vector<HUWindow>& windows,
+                  std::vector<cv::Mat>& dsts8u, RescaleParams rescale = {});
+
+// "bone,lung" o "40/400,-600/1500" (center/width) -> ventanas. Nombres:
+// soft, bone, lung. Lanza std::runtime_error si alguna no se reconoce.
+std::vector<HUWindow> parseWindowList(const std::string& list);